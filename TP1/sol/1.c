@@ -1,6 +1,27 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+//
+typedef unsigned short     u16;
+typedef unsigned int       u32;
+typedef unsigned long long u64;
+
+//k-step jump: T^k(2^k * a + r) = mul * a + add, worth steps regular steps
+typedef struct {
+
+  u32 mul;
+  u32 add;
+  u32 steps;
+  
+} collatz_jump_t;
+
+//Tables generated at build time by collatz_jump_gen (see makefile)
+#include "collatz_jump.h"
 
 //
 unsigned long long collatz_c(unsigned long long n)
@@ -70,12 +91,726 @@ unsigned long long collatz_asm(unsigned long long n) {
   return i;  //函数返回迭代次数 i 的值，即Collatz猜想中将输入整数 n 变为1所需的迭代次数
 }
 
+//Reads the Time Stamp Counter (CPU cycles)
+static inline u64 rdtsc()
+{
+  u64 a, d;
+  
+  __asm__ volatile ("rdtsc" : "=a" (a), "=d" (d));
+
+  return ((d << 32) | a);
+}
+
+//Scalar reference: out[n - lo] = collatz_c(n) for lo <= n < hi
+void collatz_range_c(u64 lo, u64 hi, u64 *out)
+{
+  for (u64 n = lo; n < hi; n++)
+    out[n - lo] = collatz_c(n);
+}
+
+//Retires the lanes flagged in mask m (their value reached 1) and refills them
+//with the next seeds of the range. lv, lc and ls hold the value, the iteration
+//count and the seed of each lane (seed 0 marks an empty lane).
+//Returns 0 once the range is exhausted.
+static int collatz_refill(u64 *lv, u64 *lc, u64 *ls, unsigned m,
+			  u64 *next, u64 lo, u64 hi, u64 *out)
+{
+  for (unsigned l = 0; m; l++, m >>= 1)
+    if (m & 1)
+      {
+	//Retire
+	if (ls[l])
+	  out[ls[l] - lo] = lc[l];
+
+	ls[l] = 0;
+
+	//Seed 1 is already converged
+	if (*next == 1 && *next < hi)
+	  out[1 - lo] = 1, (*next)++;
+	
+	if (*next >= hi)
+	  return 0;
+
+	//Refill
+	ls[l] = lv[l] = (*next)++;
+	lc[l] = 1;
+      }
+  
+  return 1;
+}
+
+//Finishes the lanes still in flight once the range is exhausted
+static void collatz_drain(u64 *lv, u64 *lc, u64 *ls, unsigned nl, u64 lo, u64 *out)
+{
+  for (unsigned l = 0; l < nl; l++)
+    if (ls[l])
+      out[ls[l] - lo] = lc[l] + collatz_c(lv[l]) - 1;
+}
+
+//AVX2 version: 4 seeds in flight, one per 64-bit lane.
+//Both branches are computed and blended on the parity of each lane, and a lane
+//that reaches 1 is retired and refilled on its own while the others keep going.
+__attribute__((target("avx2")))
+void collatz_range_avx2(u64 lo, u64 hi, u64 *out)
+{
+  u64 next = lo;
+  u64 lv[4] = { 1, 1, 1, 1 };
+  u64 lc[4] = { 1, 1, 1, 1 };
+  u64 ls[4] = { 0, 0, 0, 0 };
+  
+  const __m256i one = _mm256_set1_epi64x(1);
+  __m256i v = _mm256_loadu_si256((__m256i *)lv);
+  __m256i c = _mm256_loadu_si256((__m256i *)lc);
+
+  while (1)
+    {
+      //Lanes that converged
+      unsigned m = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, one)));
+
+      if (m)
+	{
+	  _mm256_storeu_si256((__m256i *)lv, v);
+	  _mm256_storeu_si256((__m256i *)lc, c);
+
+	  if (!collatz_refill(lv, lc, ls, m, &next, lo, hi, out))
+	    break;
+
+	  v = _mm256_loadu_si256((__m256i *)lv);
+	  c = _mm256_loadu_si256((__m256i *)lc);
+	}
+
+      //Odd lanes: 3v + 1 = v + 2v + 1, even lanes: v / 2
+      __m256i odd = _mm256_cmpeq_epi64(_mm256_and_si256(v, one), one);
+      __m256i o   = _mm256_add_epi64(_mm256_add_epi64(v, _mm256_slli_epi64(v, 1)), one);
+      __m256i e   = _mm256_srli_epi64(v, 1);
+
+      v = _mm256_blendv_epi8(e, o, odd);
+      c = _mm256_add_epi64(c, one);
+    }
+
+  collatz_drain(lv, lc, ls, 4, lo, out);
+}
+
+//AVX-512 version: 8 seeds in flight, the parity select is a masked add
+__attribute__((target("avx512f")))
+void collatz_range_avx512(u64 lo, u64 hi, u64 *out)
+{
+  u64 next = lo;
+  u64 lv[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+  u64 lc[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+  u64 ls[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i v = _mm512_loadu_si512(lv);
+  __m512i c = _mm512_loadu_si512(lc);
+
+  while (1)
+    {
+      //Lanes that converged
+      __mmask8 m = _mm512_cmpeq_epu64_mask(v, one);
+
+      if (m)
+	{
+	  _mm512_storeu_si512(lv, v);
+	  _mm512_storeu_si512(lc, c);
+
+	  if (!collatz_refill(lv, lc, ls, m, &next, lo, hi, out))
+	    break;
+
+	  v = _mm512_loadu_si512(lv);
+	  c = _mm512_loadu_si512(lc);
+	}
+
+      //Odd lanes get (v + 2v) + 1, even lanes keep v / 2
+      __mmask8 odd = _mm512_test_epi64_mask(v, one);
+
+      v = _mm512_mask_add_epi64(_mm512_srli_epi64(v, 1), odd,
+				_mm512_add_epi64(v, _mm512_slli_epi64(v, 1)), one);
+      c = _mm512_add_epi64(c, one);
+    }
+
+  collatz_drain(lv, lc, ls, 8, lo, out);
+}
+
+//Sweeps the seeds lo <= n < hi and stores collatz_c(n) in out[n - lo].
+//The widest SIMD version supported by the CPU is picked on the first call.
+void collatz_range(u64 lo, u64 hi, u64 *out)
+{
+  static void (*f)(u64, u64, u64 *) = NULL;
+
+  if (!f)
+    {
+      if (__builtin_cpu_supports("avx512f"))
+	f = collatz_range_avx512;
+      else
+	if (__builtin_cpu_supports("avx2"))
+	  f = collatz_range_avx2;
+	else
+	  f = collatz_range_c;
+    }
+
+  f(lo, hi, out);
+}
+
+//Same count as collatz_c using the shortcut steps: an odd v becomes
+//(3v + 1) / 2 = v + (v >> 1) + 1 in one go (2 steps), and a run of t even
+//steps is skipped at once with a trailing zero count.
+u64 collatz_fast(u64 n)
+{
+  u64 t = __builtin_ctzll(n);
+  u64 v = n >> t;
+  u64 i = 1 + t;
+
+  while (v != 1)
+    {
+      v = v + (v >> 1) + 1;
+      t = __builtin_ctzll(v);
+      v >>= t;
+      i += 2 + t;
+    }
+
+  return i;
+}
+
+//Bounded stopping-time cache: len[v] holds collatz_c(v) for v < limit, 0 if unknown
+typedef struct {
+
+  //Direct-mapped table indexed by value
+  u32 *len;
+
+  //Values >= limit are never cached
+  u64 limit;
+  
+} collatz_cache_t;
+
+//
+collatz_cache_t *collatz_cache_create(u64 limit)
+{
+  if (limit < 2)
+    return printf("Error: cache limit must be >= 2\n"), NULL;
+  
+  collatz_cache_t *cc = malloc(sizeof(collatz_cache_t));
+
+  if (!cc)
+    return printf("Error: cannot allocate memory for cache\n"), NULL;
+
+  cc->len = calloc(limit, sizeof(u32));
+
+  if (!cc->len)
+    return printf("Error: cannot allocate memory for cache table\n"), free(cc), NULL;
+
+  cc->limit = limit;
+  cc->len[1] = 1;
+  
+  return cc;
+}
+
+//
+void collatz_cache_release(collatz_cache_t *cc)
+{
+  if (cc)
+    {
+      free(cc->len);
+      free(cc);
+    }
+}
+
+//collatz_fast with the cache: the walk stops as soon as the trajectory drops
+//onto a value whose length is known, then the seed's own length is recorded.
+u64 collatz_cached(u64 n, collatz_cache_t *cc)
+{
+  u64 t = __builtin_ctzll(n);
+  u64 v = n >> t;
+  u64 i = 1 + t;
+
+  while (v != 1)
+    {
+      if (v < cc->limit && cc->len[v])
+	{
+	  i += cc->len[v] - 1;
+	  break;
+	}
+      
+      v = v + (v >> 1) + 1;
+      t = __builtin_ctzll(v);
+      v >>= t;
+      i += 2 + t;
+    }
+
+  if (n < cc->limit)
+    cc->len[n] = i;
+  
+  return i;
+}
+
+//Range sweeps (same layout as collatz_range) with and without the cache
+void collatz_range_fast(u64 lo, u64 hi, u64 *out)
+{
+  for (u64 n = lo; n < hi; n++)
+    out[n - lo] = collatz_fast(n);
+}
+
+//
+void collatz_range_cached(u64 lo, u64 hi, u64 *out, collatz_cache_t *cc)
+{
+  for (u64 n = lo; n < hi; n++)
+    out[n - lo] = collatz_cached(n, cc);
+}
+
+//Jump table version of collatz_c: while v >= 2^k the trajectory cannot reach 1
+//within the next k shortcut steps, so they are applied at once from the k low
+//bits of v. The last stretch below 2^k is a single lookup.
+//If iters is not NULL, the number of loop iterations is added to it.
+u64 collatz_jump_c(u64 n, u64 *iters)
+{
+  const u64 mask = (1ULL << COLLATZ_K) - 1;
+  u64 v = n;
+  u64 i = 1;
+  u64 j = 0;
+  
+  while (v > mask)
+    {
+      const collatz_jump_t *t = &collatz_jump[v & mask];
+
+      v = t->mul * (v >> COLLATZ_K) + t->add;
+      i += t->steps;
+      j++;
+    }
+
+  if (iters)
+    *iters += j;
+  
+  return i + collatz_small[v] - 1;
+}
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//collatz_c that also tracks the highest value reached by the trajectory
+u64 collatz_c_peak(u64 n, u64 *peak)
+{
+  u64 i = 1;
+  u64 v = n;
+  u64 p = n;
+
+  while (v != 1)
+    {
+      if ((v % 2) == 0)
+	v /= 2;
+      else
+	{
+	  v = (3 * v) + 1;
+
+	  if (v > p)
+	    p = v;
+	}
+      
+      i++;
+    }
+
+  *peak = p;
+  
+  return i;
+}
+
+//Record seeds of a sweep (ties go to the smallest seed)
+typedef struct {
+
+  //Longest trajectory
+  u64 len_seed;
+  u64 len;
+
+  //Highest peak
+  u64 peak_seed;
+  u64 peak;
+  
+} collatz_record_t;
+
+//Deque of seed blocks. The blocks of a thread are a contiguous range of block
+//indices: the owner pops from the bottom, thieves steal from the top.
+typedef struct {
+
+  pthread_mutex_t lock;
+  
+  u64 top;
+  u64 bottom;
+  
+} block_deque_t;
+
+//
+typedef struct sweep_thread_s {
+
+  //Thread ID
+  pthread_t id;
+  u64 tid;
+  
+  //Sweep parameters shared by all threads
+  u64 lo;
+  u64 hi;
+  u64 bs;
+  u64 nt;
+  int steal;
+  block_deque_t *dq;
+  
+  //Per thread results and statistics
+  collatz_record_t rec;
+  u64 seeds;
+  u64 blocks;
+  u64 steals;
+  double busy;
+  
+} sweep_thread_t;
+
+//Takes a block from the bottom of the thread's own deque
+static int deque_pop(block_deque_t *d, u64 *blk)
+{
+  int ok = 0;
+  
+  pthread_mutex_lock(&d->lock);
+
+  if (d->top < d->bottom)
+    *blk = --d->bottom, ok = 1;
+  
+  pthread_mutex_unlock(&d->lock);
+
+  return ok;
+}
+
+//Takes a block from the top of a victim's deque
+static int deque_steal(block_deque_t *d, u64 *blk)
+{
+  int ok = 0;
+  
+  pthread_mutex_lock(&d->lock);
+
+  if (d->top < d->bottom)
+    *blk = d->top++, ok = 1;
+  
+  pthread_mutex_unlock(&d->lock);
+
+  return ok;
+}
+
+//
+static void record_update(collatz_record_t *r, u64 n, u64 len, u64 peak)
+{
+  if (len > r->len || (len == r->len && n < r->len_seed))
+    r->len = len, r->len_seed = n;
+
+  if (peak > r->peak || (peak == r->peak && n < r->peak_seed))
+    r->peak = peak, r->peak_seed = n;
+}
+
+//Thread: drains its own deque, then steals from the others until all are empty
+void *_sweep_(void *p)
+{
+  sweep_thread_t *td = (sweep_thread_t *)p;
+  double b = now();
+  u64 blk;
+  
+  while (1)
+    {
+      int got = deque_pop(&td->dq[td->tid], &blk);
+      
+      //Victims are visited round robin starting from the next thread
+      for (u64 k = 1; !got && td->steal && k < td->nt; k++)
+	if ((got = deque_steal(&td->dq[(td->tid + k) % td->nt], &blk)))
+	  td->steals++;
+
+      if (!got)
+	break;
+
+      u64 first = td->lo + blk * td->bs;
+      u64 last  = (first + td->bs < td->hi) ? first + td->bs : td->hi;
+
+      for (u64 n = first; n < last; n++)
+	{
+	  u64 peak;
+	  u64 len = collatz_c_peak(n, &peak);
+
+	  record_update(&td->rec, n, len, peak);
+	}
+
+      td->seeds += last - first;
+      td->blocks++;
+    }
+
+  td->busy = now() - b;
+  
+  return NULL;
+}
+
+//Sweeps lo <= n < hi with nt threads over blocks of bs seeds and returns the
+//record seeds. Blocks are dealt contiguously to the threads' deques; with steal
+//set, idle threads take blocks from the others, otherwise the split is static.
+//Per thread statistics are printed when verbose is set.
+collatz_record_t collatz_sweep(u64 lo, u64 hi, u64 nt, u64 bs, int steal, int verbose)
+{
+  collatz_record_t rec = { 0, 0, 0, 0 };
+  u64 nb = (hi - lo + bs - 1) / bs;
+  
+  sweep_thread_t *td = malloc(sizeof(sweep_thread_t) * nt);
+  block_deque_t  *dq = malloc(sizeof(block_deque_t) * nt);
+
+  if (!td || !dq)
+    {
+      printf("Error: cannot allocate thread data\n");
+      exit(-1);
+    }
+
+  //
+  for (u64 i = 0; i < nt; i++)
+    {
+      pthread_mutex_init(&dq[i].lock, NULL);
+      dq[i].top    = (i * nb) / nt;
+      dq[i].bottom = ((i + 1) * nb) / nt;
+
+      memset(&td[i], 0, sizeof(sweep_thread_t));
+      
+      td[i].tid   = i;
+      td[i].lo    = lo;
+      td[i].hi    = hi;
+      td[i].bs    = bs;
+      td[i].nt    = nt;
+      td[i].steal = steal;
+      td[i].dq    = dq;
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_create(&td[i].id, NULL, _sweep_, &td[i]);
+
+  //Join and merge the per thread records
+  double max_busy = 0.0, sum_busy = 0.0;
+  
+  for (u64 i = 0; i < nt; i++)
+    {
+      pthread_join(td[i].id, NULL);
+
+      if (td[i].seeds)
+	{
+	  record_update(&rec, td[i].rec.len_seed, td[i].rec.len, 0);
+	  record_update(&rec, td[i].rec.peak_seed, 0, td[i].rec.peak);
+	}
+
+      sum_busy += td[i].busy;
+      
+      if (td[i].busy > max_busy)
+	max_busy = td[i].busy;
+    }
+
+  //Load balance: max / mean busy time (1.0 is perfect)
+  if (verbose)
+    {
+      for (u64 i = 0; i < nt; i++)
+	printf("  thread %3llu: %12llu seeds, %8llu blocks, %8llu steals, %8.3lf s\n",
+	       i, td[i].seeds, td[i].blocks, td[i].steals, td[i].busy);
+
+      printf("  imbalance (max / mean busy time): %.3lf\n", max_busy / (sum_busy / nt));
+    }
+  
+  for (u64 i = 0; i < nt; i++)
+    pthread_mutex_destroy(&dq[i].lock);
+  
+  free(td);
+  free(dq);
+  
+  return rec;
+}
+
+//Runs one range version, checks it against the reference and prints cycles per seed
+void bench_range(const char *name, void (*f)(u64, u64, u64 *), u64 lo, u64 hi, u64 *out, u64 *ref)
+{
+  memset(out, 0, sizeof(u64) * (hi - lo));
+  
+  u64 b = rdtsc();
+
+  f(lo, hi, out);
+
+  u64 a = rdtsc();
+
+  printf("%-22s: %10.2lf cycles/seed %s\n", name, (double)(a - b) / (double)(hi - lo),
+	 (ref && memcmp(out, ref, sizeof(u64) * (hi - lo))) ? "(MISMATCH)" : "");
+}
+
 //用于计算并比较Collatz猜想的迭代计算结果，同时测试C语言和内联汇编版本的Collatz计算函数。
 int main(int argc, char **argv)
 {
   //程序检查命令行参数的数量，如果少于2个参数（只有程序名和n），则打印使用说明并返回1，表示出现了错误。
   if (argc < 2)
-    return printf("Usage: %s [n]\n", argv[0]), 1;
+    return printf("Usage: %s [n]\n"
+		  "       %s range [lo] [hi]\n"
+		  "       %s bench [lo] [hi] [cache limit]\n"
+		  "       %s jump [lo] [hi]\n"
+		  "       %s sweep [lo] [hi] [threads] [block size]\n",
+		  argv[0], argv[0], argv[0], argv[0], argv[0]), 1;
+
+  //Parallel record search: static split against work stealing
+  if (!strcmp(argv[1], "sweep"))
+    {
+      if (argc < 5)
+	return printf("Usage: %s sweep [lo] [hi] [threads] [block size]\n", argv[0]), 1;
+
+      u64 lo = atoll(argv[2]);
+      u64 hi = atoll(argv[3]);
+      u64 nt = atoll(argv[4]);
+      u64 bs = (argc > 5) ? atoll(argv[5]) : 4096;
+
+      if (lo == 0 || hi <= lo)
+	return printf("Error: range must satisfy 0 < lo < hi\n"), 2;
+
+      if (!nt || !bs)
+	return printf("Error: threads and block size must be > 0\n"), 2;
+      
+      for (int steal = 0; steal < 2; steal++)
+	{
+	  printf("%s:\n", steal ? "work stealing" : "static split");
+	  
+	  double b = now();
+	  collatz_record_t r = collatz_sweep(lo, hi, nt, bs, steal, 1);
+	  double a = now();
+
+	  printf("  longest trajectory: seed %llu, length %llu\n", r.len_seed, r.len);
+	  printf("  highest peak      : seed %llu, peak %llu\n", r.peak_seed, r.peak);
+	  printf("  %.3lf s, %.0lf seeds/s\n\n", a - b, (hi - lo) / (a - b));
+	}
+      
+      return 0;
+    }
+
+  //Jump table benchmark: loop iterations and seeds/second against the one step loop
+  if (!strcmp(argv[1], "jump"))
+    {
+      if (argc < 4)
+	return printf("Usage: %s jump [lo] [hi]\n", argv[0]), 1;
+
+      u64 lo = atoll(argv[2]);
+      u64 hi = atoll(argv[3]);
+
+      if (lo == 0 || hi <= lo)
+	return printf("Error: range must satisfy 0 < lo < hi\n"), 2;
+
+      u64 s_c = 0, s_j = 0;
+      u64 it_c = 0, it_j = 0;
+      double b, a, e_c, e_j;
+      
+      //One step per iteration (collatz_c, collatz_asm): length - 1 iterations
+      b = now();
+      
+      for (u64 n = lo; n < hi; n++)
+	s_c += collatz_c(n);
+
+      a = now();
+      e_c = a - b;
+      it_c = s_c - (hi - lo);
+
+      //
+      b = now();
+      
+      for (u64 n = lo; n < hi; n++)
+	s_j += collatz_jump_c(n, &it_j);
+
+      a = now();
+      e_j = a - b;
+
+      printf("k = %d\n", COLLATZ_K);
+      printf("collatz_c      : %8.2lf iterations/seed, %12.0lf seeds/s\n",
+	     (double)it_c / (hi - lo), (hi - lo) / e_c);
+      printf("collatz_jump_c : %8.2lf iterations/seed, %12.0lf seeds/s %s\n",
+	     (double)it_j / (hi - lo), (hi - lo) / e_j, (s_c != s_j) ? "(MISMATCH)" : "");
+      
+      return 0;
+    }
+
+  //Sweep benchmark: seeds/second of the shortcut walk with the cache off and on
+  if (!strcmp(argv[1], "bench"))
+    {
+      if (argc < 4)
+	return printf("Usage: %s bench [lo] [hi] [cache limit]\n", argv[0]), 1;
+
+      u64 lo    = atoll(argv[2]);
+      u64 hi    = atoll(argv[3]);
+      u64 limit = (argc > 4) ? atoll(argv[4]) : (1ULL << 24);
+
+      if (lo == 0 || hi <= lo)
+	return printf("Error: range must satisfy 0 < lo < hi\n"), 2;
+
+      u64 *ref = malloc(sizeof(u64) * (hi - lo));
+      u64 *out = malloc(sizeof(u64) * (hi - lo));
+
+      if (!ref || !out)
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      collatz_cache_t *cc = collatz_cache_create(limit);
+
+      if (!cc)
+	return 3;
+
+      double b, a;
+      
+      b = now();
+      collatz_range_c(lo, hi, ref);
+      a = now();
+      printf("collatz_c                : %12.0lf seeds/s\n", (hi - lo) / (a - b));
+
+      b = now();
+      collatz_range_fast(lo, hi, out);
+      a = now();
+      printf("collatz_fast (cache off) : %12.0lf seeds/s %s\n", (hi - lo) / (a - b),
+	     memcmp(out, ref, sizeof(u64) * (hi - lo)) ? "(MISMATCH)" : "");
+
+      b = now();
+      collatz_range_cached(lo, hi, out, cc);
+      a = now();
+      printf("collatz_cached (cache on): %12.0lf seeds/s (limit: %llu) %s\n", (hi - lo) / (a - b), limit,
+	     memcmp(out, ref, sizeof(u64) * (hi - lo)) ? "(MISMATCH)" : "");
+
+      collatz_cache_release(cc);
+      free(ref);
+      free(out);
+
+      return 0;
+    }
+
+  //Range sweep: compare the scalar and SIMD versions over lo <= n < hi
+  if (!strcmp(argv[1], "range"))
+    {
+      if (argc < 4)
+	return printf("Usage: %s range [lo] [hi]\n", argv[0]), 1;
+
+      u64 lo = atoll(argv[2]);
+      u64 hi = atoll(argv[3]);
+
+      if (lo == 0 || hi <= lo)
+	return printf("Error: range must satisfy 0 < lo < hi\n"), 2;
+
+      u64 *ref = malloc(sizeof(u64) * (hi - lo));
+      u64 *out = malloc(sizeof(u64) * (hi - lo));
+
+      if (!ref || !out)
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      bench_range("collatz_range_c", collatz_range_c, lo, hi, ref, NULL);
+      
+      if (__builtin_cpu_supports("avx2"))
+	bench_range("collatz_range_avx2", collatz_range_avx2, lo, hi, out, ref);
+
+      if (__builtin_cpu_supports("avx512f"))
+	bench_range("collatz_range_avx512", collatz_range_avx512, lo, hi, out, ref);
+
+      bench_range("collatz_range", collatz_range, lo, hi, out, ref);
+
+      free(ref);
+      free(out);
+      
+      return 0;
+    }
   
   //程序将命令行参数argv[1]（第二个参数）转换为无符号长整数类型，并存储在变量n中。
   unsigned long long n = atoll(argv[1]);
@@ -87,6 +822,7 @@ int main(int argc, char **argv)
   //程序使用collatz_c和collatz_asm函数分别计算Collatz猜想中对输入整数n的迭代计算结果，并将它们的结果打印出来。
   printf("collatz_c(%llu)  : %llu\n", n, collatz_c(n));
   printf("collatz_asm(%llu): %llu\n", n, collatz_asm(n));
+  printf("collatz_jump_c(%llu): %llu\n", n, collatz_jump_c(n, NULL));
   
   
   //程序返回0，表示成功执行。
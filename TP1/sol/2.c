@@ -1,6 +1,12 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+//
+typedef unsigned long long u64;
 
 //
 unsigned long long fibo_c(unsigned long long n)
@@ -72,12 +78,1063 @@ unsigned long long fibo_asm(unsigned long long n)
   return f;
 }
 
+//Fast doubling with F(0) = 0, F(1) = 1:
+//  F(2k)     = F(k) * (2F(k + 1) - F(k))
+//  F(2k + 1) = F(k)^2 + F(k + 1)^2
+//Returns the same value as fibo_c (F(n + 1)) in O(log n) steps. Past n = 92
+//the result wraps modulo 2^64, exactly like the linear loop.
+u64 fibo_fast(u64 n)
+{
+  u64 m = n + 1;
+  u64 a = 0; //F(k)
+  u64 b = 1; //F(k + 1)
+
+  for (int i = 63 - __builtin_clzll(m); i >= 0; i--)
+    {
+      u64 c = a * ((2 * b) - a);
+      u64 d = (a * a) + (b * b);
+
+      if ((m >> i) & 1)
+	a = d, b = c + d;
+      else
+	a = c, b = d;
+    }
+
+  return a;
+}
+
+//
+// Big numbers: arrays of 64-bit limbs, least significant limb first
+//
+
+//Below this size squaring is done schoolbook, Karatsuba above
+#define BN_KARA_THRESHOLD 32
+
+//r = a + b over n limbs (adc chain), returns the carry out
+u64 bn_add_n(u64 *r, const u64 *a, const u64 *b, u64 n)
+{
+  u64 c = 0;
+
+  if (!n)
+    return 0;
+  
+  __asm__ volatile(
+		   "xor %%r8, %%r8;\n" //Index, also clears CF
+
+		   "1:;\n"
+		   "mov (%[_a], %%r8, 8), %%rax;\n"
+		   "adc (%[_b], %%r8, 8), %%rax;\n"
+		   "mov %%rax, (%[_r], %%r8, 8);\n"
+
+		   //inc and dec leave CF untouched
+		   "inc %%r8;\n"
+		   "dec %[_n];\n"
+		   "jnz 1b;\n"
+
+		   "setc %b[_c];\n"
+		   
+		   : //outputs
+		     [_c] "+r" (c),
+		     [_n] "+r" (n)
+		     
+		   : //inputs
+		     [_r] "r" (r),
+		     [_a] "r" (a),
+		     [_b] "r" (b)
+		     
+		   : //clobber
+		     "cc", "memory", "rax", "r8");
+
+  return c;
+}
+
+//r = a - b over n limbs (sbb chain), returns the borrow out
+u64 bn_sub_n(u64 *r, const u64 *a, const u64 *b, u64 n)
+{
+  u64 c = 0;
+
+  if (!n)
+    return 0;
+  
+  __asm__ volatile(
+		   "xor %%r8, %%r8;\n"
+
+		   "1:;\n"
+		   "mov (%[_a], %%r8, 8), %%rax;\n"
+		   "sbb (%[_b], %%r8, 8), %%rax;\n"
+		   "mov %%rax, (%[_r], %%r8, 8);\n"
+
+		   "inc %%r8;\n"
+		   "dec %[_n];\n"
+		   "jnz 1b;\n"
+
+		   "setc %b[_c];\n"
+		   
+		   : //outputs
+		     [_c] "+r" (c),
+		     [_n] "+r" (n)
+		     
+		   : //inputs
+		     [_r] "r" (r),
+		     [_a] "r" (a),
+		     [_b] "r" (b)
+		     
+		   : //clobber
+		     "cc", "memory", "rax", "r8");
+
+  return c;
+}
+
+//r[0..n) += a[0..n) * b with mulx, returns the carry limb
+__attribute__((target("bmi2")))
+u64 bn_addmul_1_mulx(u64 *r, const u64 *a, u64 n, u64 b)
+{
+  u64 c = 0;
+
+  __asm__ volatile(
+		   "xor %%r8, %%r8;\n" //Index
+		   "xor %%r9, %%r9;\n" //Carry limb
+
+		   "1:;\n"
+		   "mulx (%[_a], %%r8, 8), %%rax, %%r10;\n" //r10:rax = a[i] * rdx (flags untouched)
+		   "add %%r9, %%rax;\n"
+		   "adc $0, %%r10;\n"
+		   "add %%rax, (%[_r], %%r8, 8);\n"
+		   "adc $0, %%r10;\n"
+		   "mov %%r10, %%r9;\n"
+		   
+		   "inc %%r8;\n"
+		   "cmp %[_n], %%r8;\n"
+		   "jb 1b;\n"
+
+		   "mov %%r9, %[_c];\n"
+		   
+		   : //outputs
+		     [_c] "=r" (c)
+		     
+		   : //inputs
+		     [_r] "r" (r),
+		     [_a] "r" (a),
+		     [_n] "r" (n),
+		     "d" (b)
+		     
+		   : //clobber
+		     "cc", "memory", "rax", "r8", "r9", "r10");
+
+  return c;
+}
+
+//Portable version for CPUs without BMI2
+u64 bn_addmul_1_c(u64 *r, const u64 *a, u64 n, u64 b)
+{
+  u64 c = 0;
+
+  for (u64 i = 0; i < n; i++)
+    {
+      unsigned __int128 t = (unsigned __int128)a[i] * b + r[i] + c;
+
+      r[i] = (u64)t;
+      c = (u64)(t >> 64);
+    }
+
+  return c;
+}
+
+//
+u64 bn_addmul_1(u64 *r, const u64 *a, u64 n, u64 b)
+{
+  static int bmi2 = -1;
+
+  if (bmi2 < 0)
+    bmi2 = __builtin_cpu_supports("bmi2");
+  
+  return bmi2 ? bn_addmul_1_mulx(r, a, n, b) : bn_addmul_1_c(r, a, n, b);
+}
+
+//r = a + b with na >= nb, r holds na limbs, returns the carry out
+u64 bn_add(u64 *r, const u64 *a, u64 na, const u64 *b, u64 nb)
+{
+  u64 c = bn_add_n(r, a, b, nb);
+
+  for (u64 i = nb; i < na; i++)
+    {
+      r[i] = a[i] + c;
+      c = (r[i] < c);
+    }
+  
+  return c;
+}
+
+//r = a - b with na >= nb, r holds na limbs, returns the borrow out
+u64 bn_sub(u64 *r, const u64 *a, u64 na, const u64 *b, u64 nb)
+{
+  u64 c = bn_sub_n(r, a, b, nb);
+
+  for (u64 i = nb; i < na; i++)
+    {
+      u64 b = (a[i] < c);
+      
+      r[i] = a[i] - c;
+      c = b;
+    }
+  
+  return c;
+}
+
+//Compares a and b, the shorter one being zero extended
+int bn_cmp(const u64 *a, u64 na, const u64 *b, u64 nb)
+{
+  for (u64 i = (na > nb) ? na : nb; i-- > 0; )
+    {
+      u64 x = (i < na) ? a[i] : 0;
+      u64 y = (i < nb) ? b[i] : 0;
+
+      if (x != y)
+	return (x > y) ? 1 : -1;
+    }
+
+  return 0;
+}
+
+//r[0..na + nb) = a * b, schoolbook
+void bn_mul_basecase(u64 *r, const u64 *a, u64 na, const u64 *b, u64 nb)
+{
+  for (u64 i = 0; i < na + nb; i++)
+    r[i] = 0;
+
+  for (u64 j = 0; j < nb; j++)
+    r[na + j] = bn_addmul_1(r + j, a, na, b[j]);
+}
+
+//r[0..2n) = a^2, Karatsuba: with a = x1 * B^m + x0 and d = |x0 - x1|,
+//a^2 = x1^2 * B^2m + (x0^2 + x1^2 - d^2) * B^m + x0^2.
+//s is scratch space of at least 6n + 64 limbs.
+void bn_sqr(u64 *r, const u64 *a, u64 n, u64 *s)
+{
+  if (n < BN_KARA_THRESHOLD)
+    {
+      bn_mul_basecase(r, a, n, a, n);
+      return;
+    }
+
+  u64 m = (n + 1) / 2;
+  u64 h = n - m;
+  const u64 *x0 = a;
+  const u64 *x1 = a + m;
+
+  u64 *d  = s;               //m limbs
+  u64 *t  = d + m;           //2m + 1 limbs
+  u64 *e  = t + (2 * m) + 1; //2m limbs
+  u64 *ns = e + (2 * m);     //Scratch for the recursive calls
+  
+  //d = |x0 - x1|
+  if (bn_cmp(x0, m, x1, h) >= 0)
+    bn_sub(d, x0, m, x1, h);
+  else
+    {
+      //x1 > x0: when x1 is shorter, the top limb of x0 is 0
+      bn_sub_n(d, x1, x0, h);
+
+      if (h < m)
+	d[m - 1] = 0;
+    }
+
+  //x0^2 and x1^2 go straight to their place in r
+  bn_sqr(r, x0, m, ns);
+  bn_sqr(r + (2 * m), x1, h, ns);
+  bn_sqr(e, d, m, ns);
+
+  //t = x0^2 + x1^2 - d^2 = 2 * x0 * x1
+  for (u64 i = 0; i < 2 * m; i++)
+    t[i] = r[i];
+
+  t[2 * m] = bn_add(t, t, 2 * m, r + (2 * m), 2 * h);
+  bn_sub(t, t, (2 * m) + 1, e, 2 * m);
+
+  //Middle term, the sum fits in 2n limbs
+  bn_add(r + m, r + m, (2 * n) - m, t, ((2 * m) + 1 < (2 * n) - m) ? (2 * m) + 1 : (2 * n) - m);
+}
+
+//Strips leading zero limbs
+static inline u64 bn_norm(const u64 *a, u64 n)
+{
+  while (n > 1 && !a[n - 1])
+    n--;
+
+  return n;
+}
+
+//Limbs needed to hold F(m): F(m) < phi^m and log2(phi) < 0.6943
+static inline u64 bn_fibo_limbs(u64 m)
+{
+  return (u64)((double)m * 0.6943 / 64.0) + 2;
+}
+
+//Big number F(n + 1) (same indexing as fibo_c) by fast doubling. Each step
+//squares F(k), F(k + 1) and their difference d:
+//  F(2k) = F(k + 1)^2 - d^2,  F(2k + 1) = F(k)^2 + F(k + 1)^2
+//Returns a malloc'ed limb array, its length is stored in len.
+u64 *fibo_big(u64 n, u64 *len)
+{
+  u64 m = n + 1;
+  u64 cap = bn_fibo_limbs(m + 1);
+  u64 sz = (2 * cap) + 2;
+
+  //a = F(k), b = F(k + 1), x, y, z hold the squares
+  u64 *a = calloc(sz, sizeof(u64));
+  u64 *b = calloc(sz, sizeof(u64));
+  u64 *x = calloc(sz, sizeof(u64));
+  u64 *y = calloc(sz, sizeof(u64));
+  u64 *z = calloc(sz, sizeof(u64));
+  u64 *d = calloc(cap + 1, sizeof(u64));
+  u64 *s = calloc((6 * cap) + 64, sizeof(u64));
+
+  if (!a || !b || !x || !y || !z || !d || !s)
+    {
+      printf("Error: cannot allocate memory for big numbers\n");
+      exit(-1);
+    }
+
+  u64 na = 1, nb = 1;
+
+  b[0] = 1;
+  
+  for (int i = 63 - __builtin_clzll(m); i >= 0; i--)
+    {
+      //a is zero extended to the length of b (b >= a)
+      u64 l = nb;
+
+      for (u64 j = na; j < l; j++)
+	a[j] = 0;
+      
+      bn_sub_n(d, b, a, l);
+      
+      bn_sqr(x, a, l, s);
+      bn_sqr(y, b, l, s);
+      bn_sqr(z, d, l, s);
+
+      //z = F(2k), x = F(2k + 1)
+      bn_sub_n(z, y, z, 2 * l);
+      z[2 * l] = 0;
+      x[2 * l] = bn_add_n(x, x, y, 2 * l);
+
+      //Rotate the buffers
+      u64 *ta = a, *tb = b;
+      
+      if ((m >> i) & 1)
+	{
+	  //F(2k + 1), F(2k + 2) = F(2k) + F(2k + 1)
+	  bn_add_n(y, z, x, (2 * l) + 1);
+	  a = x, b = y;
+	  x = ta, y = tb;
+	}
+      else
+	{
+	  //F(2k), F(2k + 1)
+	  a = z, b = x;
+	  z = ta, x = tb;
+	}
+
+      na = bn_norm(a, (2 * l) + 1);
+      nb = bn_norm(b, (2 * l) + 1);
+    }
+
+  free(b); free(x); free(y); free(z); free(d); free(s);
+
+  *len = na;
+  
+  return a;
+}
+
+//Linear reference for fibo_big: one big addition per term
+u64 *fibo_big_linear(u64 n, u64 *len)
+{
+  u64 cap = bn_fibo_limbs(n + 3);
+  u64 *f0 = calloc(cap, sizeof(u64));
+  u64 *f1 = calloc(cap, sizeof(u64));
+
+  if (!f0 || !f1)
+    {
+      printf("Error: cannot allocate memory for big numbers\n");
+      exit(-1);
+    }
+
+  u64 l = 1;
+  
+  f0[0] = f1[0] = 1;
+
+  //f0 = f0 + f1, then swap: f1 ends up with the new term
+  for (u64 i = 1; i < n; i++)
+    {
+      if ((f0[l] = bn_add_n(f0, f0, f1, l)))
+	l++;
+
+      u64 *t = f0; f0 = f1; f1 = t;
+    }
+
+  free(f0);
+
+  *len = l;
+  
+  return f1;
+}
+
+//Prints a big number in decimal, fine for a few thousand limbs (quadratic)
+void bn_print(const u64 *a, u64 n)
+{
+  u64 *t = malloc(sizeof(u64) * n);
+  u64 *c = malloc(sizeof(u64) * ((2 * n) + 1));
+  u64 nc = 0;
+
+  if (!t || !c)
+    {
+      printf("Error: cannot allocate memory\n");
+      exit(-1);
+    }
+
+  for (u64 i = 0; i < n; i++)
+    t[i] = a[i];
+
+  //Chunks of 19 digits, least significant first
+  do
+    {
+      unsigned __int128 r = 0;
+
+      for (u64 i = n; i-- > 0; )
+	{
+	  r = (r << 64) | t[i];
+	  t[i] = (u64)(r / 10000000000000000000ULL);
+	  r %= 10000000000000000000ULL;
+	}
+
+      c[nc++] = (u64)r;
+      n = bn_norm(t, n);
+    }
+  while (n > 1 || t[0]);
+
+  printf("%llu", c[nc - 1]);
+
+  for (u64 i = nc - 1; i-- > 0; )
+    printf("%019llu", c[i]);
+
+  putchar('\n');
+
+  free(t);
+  free(c);
+}
+
+//
+// F(n) mod m
+//
+
+//Linear loop modulo m (fibo_c indexing: F(n + 1) mod m)
+u64 fibo_mod_c(u64 n, u64 m)
+{
+  u64 f0 = 1 % m;
+  u64 f1 = 1 % m;
+
+  for (u64 i = 1; i < n; i++)
+    {
+      u64 t = f1;
+
+      f1 = (f1 + f0) % m;
+      f0 = t;
+    }
+
+  return f1;
+}
+
+//
+static inline u64 mulmod(u64 a, u64 b, u64 m)
+{
+  return (u64)(((unsigned __int128)a * b) % m);
+}
+
+//F(k) mod m and F(k + 1) mod m by fast doubling (standard indexing), m < 2^63
+void fibo_mod_pair(u64 k, u64 m, u64 *fk, u64 *fk1)
+{
+  u64 a = 0;
+  u64 b = 1 % m;
+
+  for (int i = k ? 63 - __builtin_clzll(k) : -1; i >= 0; i--)
+    {
+      u64 c = mulmod(a, (2 * b + m - a) % m, m);
+      u64 d = (mulmod(a, a, m) + mulmod(b, b, m)) % m;
+
+      if ((k >> i) & 1)
+	a = d, b = (c + d) % m;
+      else
+	a = c, b = d;
+    }
+
+  *fk  = a;
+  *fk1 = b;
+}
+
+//Scalar fast doubling version of fibo_mod_c
+u64 fibo_mod(u64 n, u64 m)
+{
+  u64 a, b;
+
+  fibo_mod_pair(n + 1, m, &a, &b);
+
+  return a;
+}
+
+//Trial division, fills p[] with the distinct prime factors and e[] with their
+//exponents, returns the number of factors (at most 15 below 2^64)
+static int factor(u64 n, u64 *p, u64 *e)
+{
+  int c = 0;
+
+  for (u64 d = 2; d * d <= n; d += (d == 2) ? 1 : 2)
+    if (n % d == 0)
+      {
+	p[c] = d;
+	e[c] = 0;
+
+	while (n % d == 0)
+	  n /= d, e[c]++;
+
+	c++;
+      }
+
+  if (n > 1)
+    p[c] = n, e[c] = 1, c++;
+
+  return c;
+}
+
+//
+static u64 gcd(u64 a, u64 b)
+{
+  while (b)
+    {
+      u64 t = a % b;
+
+      a = b;
+      b = t;
+    }
+
+  return a;
+}
+
+//Pisano period of a prime p: the smallest divisor d of p - 1 (p = +-1 mod 5)
+//or 2(p + 1) (p = +-2 mod 5) with F(d) = 0 and F(d + 1) = 1 mod p
+static u64 pisano_prime(u64 p)
+{
+  if (p == 2)
+    return 3;
+
+  if (p == 5)
+    return 20;
+
+  u64 d = (p % 5 == 1 || p % 5 == 4) ? p - 1 : 2 * (p + 1);
+  u64 q[16], e[16];
+  int c = factor(d, q, e);
+
+  for (int i = 0; i < c; i++)
+    while (d % q[i] == 0)
+      {
+	u64 a, b;
+
+	fibo_mod_pair(d / q[i], p, &a, &b);
+
+	if (a != 0 || b != 1)
+	  break;
+
+	d /= q[i];
+      }
+
+  return d;
+}
+
+//Pisano period of m: lcm of p^(k - 1) * pi(p) over the prime powers p^k of m
+u64 pisano(u64 m)
+{
+  u64 p[16], e[16];
+  u64 r = 1;
+  int c = factor(m, p, e);
+
+  for (int i = 0; i < c; i++)
+    {
+      u64 t = pisano_prime(p[i]);
+
+      for (u64 j = 1; j < e[i]; j++)
+	t *= p[i];
+
+      r = (r / gcd(r, t)) * t;
+    }
+
+  return r;
+}
+
+//Per modulus constants: m = 2^s * o with o odd. Besides the Pisano period the
+//entry keeps what the batch needs for the Montgomery lanes on o and for the
+//CRT recombination with the power of 2 part.
+typedef struct {
+
+  u64 m;   //Modulus (0 if the entry is empty)
+  u64 pi;  //Pisano period of m
+  u64 o;   //Odd part of m
+  u64 s;   //Power of 2 part exponent
+  u64 mp;  //-o^-1 mod 2^32
+  u64 r1;  //2^32 mod o (1 in Montgomery form)
+  u64 inv; //o^-1 mod 2^64
+  
+} pisano_entry_t;
+
+//Bounded cache of Pisano periods, indexed by a hash of the modulus
+typedef struct {
+
+  //
+  pisano_entry_t *e;
+
+  //Number of entries (power of 2)
+  u64 size;
+
+  //Statistics
+  u64 hits;
+  u64 misses;
+  
+} pisano_cache_t;
+
+//
+pisano_cache_t *pisano_cache_create(u64 size)
+{
+  if (size < 2 || (size & (size - 1)))
+    return printf("Error: cache size must be a power of 2 (>= 2)\n"), NULL;
+
+  pisano_cache_t *pc = malloc(sizeof(pisano_cache_t));
+
+  if (!pc)
+    return printf("Error: cannot allocate memory for cache\n"), NULL;
+
+  pc->e = calloc(size, sizeof(pisano_entry_t));
+
+  if (!pc->e)
+    return printf("Error: cannot allocate memory for cache table\n"), free(pc), NULL;
+
+  pc->size   = size;
+  pc->hits   = 0;
+  pc->misses = 0;
+  
+  return pc;
+}
+
+//
+void pisano_cache_release(pisano_cache_t *pc)
+{
+  if (pc)
+    {
+      free(pc->e);
+      free(pc);
+    }
+}
+
+//Montgomery arithmetic with R = 2^32 for odd m < 2^32. Each query sits in a
+//64-bit lane holding a 32-bit value, so a single vpmuludq gives the full
+//products; mp is -m^-1 mod 2^32 and values stay in [0, m).
+#define MONT_MAX_M (1ULL << 32)
+
+//-m^-1 mod 2^32 for odd m (Newton iteration, each step doubles the valid bits)
+static inline u64 mont_mp(u64 m)
+{
+  unsigned int inv = (unsigned int)m;
+
+  for (int i = 0; i < 4; i++)
+    inv *= 2 - (unsigned int)m * inv;
+
+  return (unsigned int)-inv;
+}
+
+//u in [0, 2m) -> [0, m)
+__attribute__((target("avx2")))
+static inline __m256i mont_reduce4(__m256i u, __m256i m)
+{
+  return _mm256_blendv_epi8(_mm256_sub_epi64(u, m), u, _mm256_cmpgt_epi64(m, u));
+}
+
+//a * b * R^-1 mod m
+__attribute__((target("avx2")))
+static inline __m256i mont_mul4(__m256i a, __m256i b, __m256i m, __m256i mp)
+{
+  const __m256i lo = _mm256_set1_epi64x(0xFFFFFFFFULL);
+  __m256i t = _mm256_mul_epu32(a, b);
+  __m256i q = _mm256_mul_epu32(t, mp);
+  
+  //t + q * m may not fit in 64 bits: add the high halves, its low half is 0
+  //so the carry out of the low halves is 1 unless t's low half is 0
+  __m256i c = _mm256_srli_epi64(_mm256_add_epi64(_mm256_and_si256(t, lo), lo), 32);
+  __m256i u = _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(t, 32),
+						 _mm256_srli_epi64(_mm256_mul_epu32(q, m), 32)), c);
+
+  return mont_reduce4(u, m);
+}
+
+//Fast doubling on 4 queries at once: k, m, mp and r1 (R mod m) hold one query
+//per lane, nb is the bit length of the largest k. Leading zero bits are
+//harmless since the doubling of k = 0 gives k = 0 again.
+__attribute__((target("avx2")))
+void fibo_mont4(const u64 *k, const u64 *m, const u64 *mp, const u64 *r1, int nb, u64 *out)
+{
+  const __m256i one = _mm256_set1_epi64x(1);
+  __m256i vk  = _mm256_loadu_si256((__m256i *)k);
+  __m256i vm  = _mm256_loadu_si256((__m256i *)m);
+  __m256i vmp = _mm256_loadu_si256((__m256i *)mp);
+  __m256i a   = _mm256_setzero_si256();
+  __m256i b   = _mm256_loadu_si256((__m256i *)r1);
+
+  for (int i = nb - 1; i >= 0; i--)
+    {
+      //c = a * (2b - a), d = a^2 + b^2, e = c + d
+      __m256i t = mont_reduce4(_mm256_add_epi64(b, b), vm);
+      __m256i u = mont_reduce4(_mm256_sub_epi64(_mm256_add_epi64(t, vm), a), vm);
+      __m256i c = mont_mul4(a, u, vm, vmp);
+      __m256i d = mont_reduce4(_mm256_add_epi64(mont_mul4(a, a, vm, vmp), mont_mul4(b, b, vm, vmp)), vm);
+      __m256i e = mont_reduce4(_mm256_add_epi64(c, d), vm);
+      __m256i s = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_srli_epi64(vk, i), one), one);
+
+      a = _mm256_blendv_epi8(c, d, s);
+      b = _mm256_blendv_epi8(d, e, s);
+    }
+
+  //Out of Montgomery form
+  _mm256_storeu_si256((__m256i *)out, mont_mul4(a, one, vm, vmp));
+}
+
+//Same on 8 queries with AVX-512
+__attribute__((target("avx512f")))
+static inline __m512i mont_mul8(__m512i a, __m512i b, __m512i m, __m512i mp)
+{
+  const __m512i lo = _mm512_set1_epi64(0xFFFFFFFFULL);
+  __m512i t = _mm512_mul_epu32(a, b);
+  __m512i q = _mm512_mul_epu32(t, mp);
+  __m512i c = _mm512_srli_epi64(_mm512_add_epi64(_mm512_and_si512(t, lo), lo), 32);
+  __m512i u = _mm512_add_epi64(_mm512_add_epi64(_mm512_srli_epi64(t, 32),
+						 _mm512_srli_epi64(_mm512_mul_epu32(q, m), 32)), c);
+
+  return _mm512_min_epu64(u, _mm512_sub_epi64(u, m));
+}
+
+//
+__attribute__((target("avx512f")))
+void fibo_mont8(const u64 *k, const u64 *m, const u64 *mp, const u64 *r1, int nb, u64 *out)
+{
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i vk  = _mm512_loadu_si512(k);
+  __m512i vm  = _mm512_loadu_si512(m);
+  __m512i vmp = _mm512_loadu_si512(mp);
+  __m512i a   = _mm512_setzero_si512();
+  __m512i b   = _mm512_loadu_si512(r1);
+
+  //Unsigned min folds the conditional subtraction: x - m wraps when x < m
+#define RED8(x) _mm512_min_epu64((x), _mm512_sub_epi64((x), vm))
+  
+  for (int i = nb - 1; i >= 0; i--)
+    {
+      __m512i t = RED8(_mm512_add_epi64(b, b));
+      __m512i u = RED8(_mm512_sub_epi64(_mm512_add_epi64(t, vm), a));
+      __m512i c = mont_mul8(a, u, vm, vmp);
+      __m512i d = RED8(_mm512_add_epi64(mont_mul8(a, a, vm, vmp), mont_mul8(b, b, vm, vmp)));
+      __m512i e = RED8(_mm512_add_epi64(c, d));
+      __mmask8 s = _mm512_test_epi64_mask(_mm512_srlv_epi64(vk, _mm512_set1_epi64(i)), one);
+
+      a = _mm512_mask_blend_epi64(s, c, d);
+      b = _mm512_mask_blend_epi64(s, d, e);
+    }
+
+#undef RED8
+  
+  _mm512_storeu_si512(out, mont_mul8(a, one, vm, vmp));
+}
+
+//Returns the cache entry of m, filling it on a miss. The cache is 2-way set
+//associative: a hit in the second way swaps it to the front, a miss evicts the
+//second way. The entry is only valid until the next lookup.
+const pisano_entry_t *pisano_cached(u64 m, pisano_cache_t *pc)
+{
+  pisano_entry_t *e = &pc->e[((m * 0x9E3779B97F4A7C15ULL) >> 40) & (pc->size - 2)];
+
+  if (e[0].m == m)
+    {
+      pc->hits++;
+      return e;
+    }
+
+  if (e[1].m == m)
+    {
+      pisano_entry_t t = e[0];
+      
+      e[0] = e[1];
+      e[1] = t;
+      pc->hits++;
+      
+      return e;
+    }
+
+  pc->misses++;
+
+  e[1] = e[0];
+  
+  e->m  = m;
+  e->pi = pisano(m);
+  e->s  = __builtin_ctzll(m);
+  e->o  = m >> e->s;
+  e->mp = mont_mp(e->o);
+  e->r1 = (1ULL << 32) % e->o;
+
+  //o^-1 mod 2^64, Newton again
+  e->inv = e->o;
+
+  for (int i = 0; i < 5; i++)
+    e->inv *= 2 - e->o * e->inv;
+  
+  return e;
+}
+
+//Batch of count queries: out[i] = fibo_c(n[i]) mod m[i] (m[i] > 0).
+//Indices are first reduced modulo the cached Pisano period of their modulus.
+//The odd part o of each modulus (o < MONT_MAX_M = 2^32) is handled in SIMD
+//lanes with Montgomery arithmetic, the 2^s part with wrapping 64-bit fast
+//doubling, and both are recombined by CRT. Larger moduli use the scalar fast doubling.
+void fibo_mod_batch(const u64 *n, const u64 *m, u64 *out, u64 count, pisano_cache_t *pc)
+{
+  static int w = 0;
+
+  if (!w)
+    w = __builtin_cpu_supports("avx512f") ? 8 : __builtin_cpu_supports("avx2") ? 4 : 1;
+
+  //Lane buffers
+  u64 lk[8], lm[8], lmp[8], lr1[8], lo[8];
+  u64 li[8], lr2[8], lod[8], linv[8], ls[8];
+  int l = 0, nb = 0;
+  
+  for (u64 i = 0; i <= count; i++)
+    {
+      //Flush a full group, or the last partial one (padded with o = 1 lanes)
+      if (l == w || (i == count && l))
+	{
+	  for (int j = l; j < w; j++)
+	    lk[j] = 0, lm[j] = 1, lmp[j] = mont_mp(1), lr1[j] = 0;
+	  
+	  if (w == 8)
+	    fibo_mont8(lk, lm, lmp, lr1, nb, lo);
+	  else
+	    fibo_mont4(lk, lm, lmp, lr1, nb, lo);
+
+	  //x = r_o + o * ((r_2 - r_o) * o^-1 mod 2^s)
+	  for (int j = 0; j < l; j++)
+	    {
+	      u64 mask = (1ULL << ls[j]) - 1;
+
+	      out[li[j]] = lo[j] + lod[j] * (((lr2[j] - lo[j]) * linv[j]) & mask);
+	    }
+	  
+	  l = nb = 0;
+	}
+
+      if (i == count)
+	break;
+
+      const pisano_entry_t *e = pisano_cached(m[i], pc);
+      
+      //fibo_c(n) = F(n + 1)
+      u64 k = (n[i] % e->pi) + 1;
+
+      if (k == e->pi)
+	k = 0;
+      
+      if (w == 1 || e->o >= MONT_MAX_M)
+	{
+	  u64 a, b;
+
+	  fibo_mod_pair(k, m[i], &a, &b);
+	  out[i] = a;
+	  continue;
+	}
+
+      lk[l]  = k;
+      lm[l]  = e->o;
+      lmp[l] = e->mp;
+      lr1[l] = e->r1;
+      lod[l]  = e->o;
+      linv[l] = e->inv;
+      ls[l]   = e->s;
+      li[l]   = i;
+
+      //F(k) mod 2^s, the period of 2^s is 3 * 2^(s - 1) and
+      //fibo_fast(k - 1) = F(k) mod 2^64
+      u64 k2 = e->s ? k % (3ULL << (e->s - 1)) : 0;
+      
+      lr2[l] = k2 ? fibo_fast(k2 - 1) : 0;
+      l++;
+
+      int b = k ? 64 - __builtin_clzll(k) : 0;
+
+      if (b > nb)
+	nb = b;
+    }
+}
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
 //用于计算并比较斐波那契数列中的第n项的值，同时测试C语言和内联汇编版本的斐波那契数列计算函数。
 int main(int argc, char **argv)
 {
   //程序检查命令行参数的数量，如果少于2个参数（只有程序名和n），则打印使用说明并返回1，表示出现了错误。
   if (argc < 2)
-    return printf("Usage: %s [n]\n", argv[0]), 1;
+    return printf("Usage: %s [n]\n"
+		  "       %s big [n]\n"
+		  "       %s bench [n]\n"
+		  "       %s mod [queries] [max m] [distinct moduli]\n", argv[0], argv[0], argv[0], argv[0]), 1;
+
+  //Batch of random F(n) mod m queries
+  if (!strcmp(argv[1], "mod") && argc > 3)
+    {
+      u64 count = atoll(argv[2]);
+      u64 max_m = atoll(argv[3]);
+      u64 nm    = (argc > 4) ? atoll(argv[4]) : 1000;
+
+      if (!count || max_m < 2 || !nm)
+	return printf("Error: need queries > 0, max m >= 2 and distinct moduli > 0\n"), 2;
+      
+      u64 *n   = malloc(sizeof(u64) * count);
+      u64 *m   = malloc(sizeof(u64) * count);
+      u64 *ref = malloc(sizeof(u64) * count);
+      u64 *out = malloc(sizeof(u64) * count);
+      u64 *mods = malloc(sizeof(u64) * nm);
+      pisano_cache_t *pc = pisano_cache_create(1 << 16);
+
+      if (!n || !m || !ref || !out || !mods || !pc)
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      //Queries draw their modulus from a pool of nm values
+      srand(0);
+
+      for (u64 i = 0; i < nm; i++)
+	mods[i] = 1 + (((u64)rand() << 31) ^ rand()) % max_m;
+      
+      for (u64 i = 0; i < count; i++)
+	{
+	  n[i] = ((u64)rand() << 33) ^ ((u64)rand() << 2) ^ rand();
+	  m[i] = mods[rand() % nm];
+	}
+
+      double b, a;
+
+      //The linear loop is only run on small indices
+      u64 nl = (count < 100) ? count : 100;
+      
+      b = now();
+      
+      for (u64 i = 0; i < nl; i++)
+	out[i] = fibo_mod_c(n[i] % 100000, m[i]);
+
+      a = now();
+      printf("fibo_mod_c (n < 10^5): %12.0lf queries/s\n", nl / (a - b));
+
+      //
+      b = now();
+      
+      for (u64 i = 0; i < count; i++)
+	ref[i] = fibo_mod(n[i], m[i]);
+
+      a = now();
+      printf("fibo_mod             : %12.0lf queries/s\n", count / (a - b));
+
+      //First pass fills the Pisano cache, the second one runs warm
+      for (int r = 0; r < 2; r++)
+	{
+	  b = now();
+	  fibo_mod_batch(n, m, out, count, pc);
+	  a = now();
+	  printf("fibo_mod_batch (%s) : %12.0lf queries/s %s\n", r ? "warm" : "cold", count / (a - b),
+		 memcmp(out, ref, sizeof(u64) * count) ? "(MISMATCH)" : "");
+	}
+
+      printf("pisano cache: %llu hits, %llu misses\n", pc->hits, pc->misses);
+      
+      pisano_cache_release(pc);
+      free(n); free(m); free(ref); free(out); free(mods);
+      
+      return 0;
+    }
+
+  //Exact value through big numbers
+  if (!strcmp(argv[1], "big") && argc > 2)
+    {
+      u64 n = atoll(argv[2]);
+      u64 l = 0;
+      
+      double b = now();
+      u64 *f = fibo_big(n, &l);
+      double a = now();
+
+      printf("fibo_big(%llu): %llu limbs, %.0lf bits, %.3lf s\n", n, l,
+	     64.0 * (l - 1) + (64 - __builtin_clzll(f[l - 1])), a - b);
+
+      //Decimal conversion is quadratic, only done for reasonable sizes
+      if (l <= 4096)
+	bn_print(f, l);
+      else
+	printf("low limb: %llu, top limb: 0x%016llx\n", f[0], f[l - 1]);
+
+      free(f);
+      
+      return 0;
+    }
+
+  //Linear loops against fast doubling
+  if (!strcmp(argv[1], "bench") && argc > 2)
+    {
+      u64 n = atoll(argv[2]);
+      u64 r_c = 0, r_f = 0;
+      double b, a;
+
+      //64-bit versions (wrapping past n = 92)
+      b = now();
+      r_c = fibo_c(n);
+      a = now();
+      printf("fibo_c          : %12.6lf s\n", a - b);
+      
+      b = now();
+      r_f = fibo_fast(n);
+      a = now();
+      printf("fibo_fast       : %12.6lf s %s\n", a - b, (r_c != r_f) ? "(MISMATCH)" : "");
+
+      //Big numbers, the low limb must match the wrapped 64-bit result
+      u64 l_f = 0, l_l = 0;
+      u64 *f = NULL, *g = NULL;
+      
+      b = now();
+      f = fibo_big(n, &l_f);
+      a = now();
+      printf("fibo_big        : %12.6lf s %s\n", a - b, (f[0] != r_c) ? "(MISMATCH)" : "");
+
+      //The linear big loop is quadratic, skip it when it would take minutes
+      if (n <= 1000000)
+	{
+	  b = now();
+	  g = fibo_big_linear(n, &l_l);
+	  a = now();
+	  printf("fibo_big_linear : %12.6lf s %s\n", a - b,
+		 (l_l != l_f || memcmp(f, g, sizeof(u64) * l_f)) ? "(MISMATCH)" : "");
+	}
+      
+      free(f);
+      free(g);
+      
+      return 0;
+    }
 
   //程序将命令行参数argv[1]（第二个参数）转换为无符号长整数类型，并存储在变量n中。
   unsigned long long n = atoll(argv[1]);
@@ -85,6 +1142,7 @@ int main(int argc, char **argv)
   //程序使用fibo_c和fibo_asm函数分别计算斐波那契数列中的第n项，并将它们的结果打印出来。
   printf("fibo_c(%llu): %llu\n", n, fibo_c(n));
   printf("fibo_asm(%llu): %llu\n", n, fibo_asm(n));
+  printf("fibo_fast(%llu): %llu%s\n", n, fibo_fast(n), (n > 92) ? " (wrapped, see 'big')" : "");
   
   //程序返回0，表示成功执行。
   return 0;
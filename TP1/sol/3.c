@@ -1,6 +1,13 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+//
+typedef unsigned long long u64;
 
 //函数接受三个参数：整数指针 p，表示要缩放的整数数组；无符号长整数 n，表示数组的大小；整数 s，表示缩放因子。
 void scale_c(int *p, unsigned long long n, int s)
@@ -44,12 +51,312 @@ void scale_asm(int *p, unsigned long long n, int s)
 } //该函数用于对数组 p 中的每个元素进行缩放操作，将每个元素乘以整数 s，然后将结果写回数组中，
   //以实现整数数组的缩放操作。这段代码使用内联汇编来优化数组操作，提高了执行效率。
 
+//AVX2 version: scalar peel up to a 32-byte boundary, 4 x 8 ints per iteration
+//with vpmulld, masked tail. With nt set the stores are non-temporal (for
+//arrays larger than the LLC: no read for ownership, no cache pollution).
+__attribute__((target("avx2")))
+static inline void scale_avx2_(int *p, u64 n, int s, int nt)
+{
+  u64 i = 0;
+  const __m256i vs = _mm256_set1_epi32(s);
+
+  //Prologue: peel until p + i is aligned
+  for (; i < n && ((unsigned long)(p + i) & 31); i++)
+    p[i] *= s;
+
+  //Main loop, unrolled 4 times
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i a0 = _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(p + i)), vs);
+      __m256i a1 = _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(p + i + 8)), vs);
+      __m256i a2 = _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(p + i + 16)), vs);
+      __m256i a3 = _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(p + i + 24)), vs);
+
+      if (nt)
+	{
+	  _mm256_stream_si256((__m256i *)(p + i), a0);
+	  _mm256_stream_si256((__m256i *)(p + i + 8), a1);
+	  _mm256_stream_si256((__m256i *)(p + i + 16), a2);
+	  _mm256_stream_si256((__m256i *)(p + i + 24), a3);
+	}
+      else
+	{
+	  _mm256_store_si256((__m256i *)(p + i), a0);
+	  _mm256_store_si256((__m256i *)(p + i + 8), a1);
+	  _mm256_store_si256((__m256i *)(p + i + 16), a2);
+	  _mm256_store_si256((__m256i *)(p + i + 24), a3);
+	}
+    }
+
+  //Remaining full vectors
+  for (; i + 8 <= n; i += 8)
+    _mm256_store_si256((__m256i *)(p + i), _mm256_mullo_epi32(_mm256_load_si256((__m256i *)(p + i)), vs));
+
+  //Masked tail: lanes below n - i are enabled
+  if (i < n)
+    {
+      __m256i m = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+      _mm256_maskstore_epi32(p + i, m, _mm256_mullo_epi32(_mm256_maskload_epi32(p + i, m), vs));
+    }
+
+  //Non-temporal stores are weakly ordered
+  if (nt)
+    _mm_sfence();
+}
+
+//
+__attribute__((target("avx2")))
+void scale_avx2(int *p, unsigned long long n, int s)
+{
+  scale_avx2_(p, n, s, 0);
+}
+
+//
+__attribute__((target("avx2")))
+void scale_avx2_nt(int *p, unsigned long long n, int s)
+{
+  scale_avx2_(p, n, s, 1);
+}
+
+//AVX-512 version: masked peel up to a 64-byte boundary, 4 x 16 ints per
+//iteration, masked tail
+__attribute__((target("avx512f")))
+static inline void scale_avx512_(int *p, u64 n, int s, int nt)
+{
+  u64 i = 0;
+  const __m512i vs = _mm512_set1_epi32(s);
+
+  //Prologue: one masked vector up to the first aligned address
+  u64 head = ((64 - ((unsigned long)p & 63)) & 63) / sizeof(int);
+
+  if (head > n)
+    head = n;
+  
+  if (head)
+    {
+      __mmask16 m = (1U << head) - 1;
+
+      _mm512_mask_storeu_epi32(p, m, _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m, p), vs));
+      i = head;
+    }
+
+  //Main loop, unrolled 4 times
+  for (; i + 64 <= n; i += 64)
+    {
+      __m512i a0 = _mm512_mullo_epi32(_mm512_load_si512(p + i), vs);
+      __m512i a1 = _mm512_mullo_epi32(_mm512_load_si512(p + i + 16), vs);
+      __m512i a2 = _mm512_mullo_epi32(_mm512_load_si512(p + i + 32), vs);
+      __m512i a3 = _mm512_mullo_epi32(_mm512_load_si512(p + i + 48), vs);
+
+      if (nt)
+	{
+	  _mm512_stream_si512((__m512i *)(p + i), a0);
+	  _mm512_stream_si512((__m512i *)(p + i + 16), a1);
+	  _mm512_stream_si512((__m512i *)(p + i + 32), a2);
+	  _mm512_stream_si512((__m512i *)(p + i + 48), a3);
+	}
+      else
+	{
+	  _mm512_store_si512(p + i, a0);
+	  _mm512_store_si512(p + i + 16, a1);
+	  _mm512_store_si512(p + i + 32, a2);
+	  _mm512_store_si512(p + i + 48, a3);
+	}
+    }
+
+  //Remaining full vectors
+  for (; i + 16 <= n; i += 16)
+    _mm512_store_si512(p + i, _mm512_mullo_epi32(_mm512_load_si512(p + i), vs));
+
+  //Masked tail
+  if (i < n)
+    {
+      __mmask16 m = (1U << (n - i)) - 1;
+
+      _mm512_mask_storeu_epi32(p + i, m, _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m, p + i), vs));
+    }
+
+  if (nt)
+    _mm_sfence();
+}
+
+//
+__attribute__((target("avx512f")))
+void scale_avx512(int *p, unsigned long long n, int s)
+{
+  scale_avx512_(p, n, s, 0);
+}
+
+//
+__attribute__((target("avx512f")))
+void scale_avx512_nt(int *p, unsigned long long n, int s)
+{
+  scale_avx512_(p, n, s, 1);
+}
+
+//CPU features and last level cache size, filled by scale_init
+int cpu_avx2    = 0;
+int cpu_avx512f = 0;
+u64 llc_size    = 0;
+
+//Variants picked by scale_init for arrays that fit in the LLC and for larger ones
+void (*scale_cached)(int *, unsigned long long, int) = scale_c;
+void (*scale_stream)(int *, unsigned long long, int) = scale_c;
+
+//Reads the CPU features through cpuid: leaf 1 for OSXSAVE, leaf 7 for AVX2 and
+//AVX-512F, xgetbv to check that the OS saves the YMM/ZMM state, and leaf 4
+//(deterministic cache parameters) for the size of the last level cache.
+void scale_init()
+{
+  unsigned a, b, c, d;
+
+  __cpuid(0, a, b, c, d);
+
+  u64 max_leaf = a;
+  u64 xcr0 = 0;
+  
+  __cpuid(1, a, b, c, d);
+
+  //OSXSAVE
+  if (c & (1 << 27))
+    {
+      unsigned lo, hi;
+      
+      __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+      xcr0 = ((u64)hi << 32) | lo;
+    }
+  
+  if (max_leaf >= 7)
+    {
+      __cpuid_count(7, 0, a, b, c, d);
+
+      //YMM state (bits 1, 2), then opmask and ZMM state (bits 5, 6, 7)
+      cpu_avx2    = (b & (1 << 5))  && ((xcr0 & 0x06) == 0x06);
+      cpu_avx512f = (b & (1 << 16)) && ((xcr0 & 0xE6) == 0xE6);
+    }
+
+  //Caches are enumerated until type 0, the last one is the LLC
+  if (max_leaf >= 4)
+    for (unsigned i = 0; ; i++)
+      {
+	__cpuid_count(4, i, a, b, c, d);
+
+	if (!(a & 0x1F))
+	  break;
+
+	//Ways * partitions * line size * sets
+	llc_size = (u64)(((b >> 22) & 0x3FF) + 1) * (((b >> 12) & 0x3FF) + 1) * ((b & 0xFFF) + 1) * (c + 1);
+      }
+
+  //Unknown (AMD leaf 4 is empty): assume 32 MiB
+  if (!llc_size)
+    llc_size = 32ULL << 20;
+  
+  if (cpu_avx512f)
+    scale_cached = scale_avx512, scale_stream = scale_avx512_nt;
+  else
+    if (cpu_avx2)
+      scale_cached = scale_avx2, scale_stream = scale_avx2_nt;
+}
+
+//Scales with the variant selected by scale_init: arrays larger than the LLC
+//would be evicted anyway, they go through non-temporal stores
+void scale(int *p, unsigned long long n, int s)
+{
+  if (sizeof(int) * n > llc_size)
+    scale_stream(p, n, s);
+  else
+    scale_cached(p, n, s);
+}
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//Times reps calls of f on p (n ints, each read and written once per call)
+//and checks the result against scale_c
+void bench_scale(const char *name, void (*f)(int *, unsigned long long, int),
+		 int *p, int *ref, unsigned long long n, u64 reps)
+{
+  //s = 1 keeps the values stable across repetitions
+  for (unsigned long long i = 0; i < n; i++)
+    p[i] = i + 1;
+
+  double b = now();
+
+  for (u64 r = 0; r < reps; r++)
+    f(p, n, 1);
+
+  double a = now();
+  
+  //One more call with a real factor for the check
+  f(p, n, 3);
+  
+  printf("%-16s: %8.2lf GB/s %s\n", name, (2.0 * sizeof(int) * n * reps) / (a - b) / 1e9,
+	 memcmp(p, ref, sizeof(int) * n) ? "(MISMATCH)" : "");
+}
+
 //演示和比较使用C语言和内联汇编语言编写的缩放整数数组的功能
 int main(int argc, char **argv)
 {
   //程序检查命令行参数的数量，如果少于3个参数（程序名、n、s），则打印使用说明并返回1，表示出现了错误。
   if (argc < 3)
-    return printf("Usage: %s [n] [s]\n", argv[0]), 1;
+    return printf("Usage: %s [n] [s]\n"
+		  "       %s bench [n] [reps]\n", argv[0], argv[0]), 1;
+
+  //Picks the SIMD variants from cpuid
+  scale_init();
+
+  //Bandwidth of every variant the CPU supports
+  if (!strcmp(argv[1], "bench"))
+    {
+      unsigned long long n = atoll(argv[2]);
+      u64 reps = (argc > 3) ? atoll(argv[3]) : 1 + (1ULL << 28) / (n + 1);
+
+      if (!n)
+	return printf("Error: 'n' must be > 0\n"), 2;
+      
+      int *p   = malloc(sizeof(int) * n);
+      int *ref = malloc(sizeof(int) * n);
+
+      if (!p || !ref)
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      for (unsigned long long i = 0; i < n; i++)
+	ref[i] = 3 * (i + 1);
+
+      printf("n: %llu (%.2lf MiB), LLC: %llu KiB, avx2: %d, avx512f: %d, reps: %llu\n",
+	     n, (sizeof(int) * n) / 1048576.0, llc_size >> 10, cpu_avx2, cpu_avx512f, reps);
+      
+      bench_scale("scale_c", scale_c, p, ref, n, reps);
+      bench_scale("scale_asm", scale_asm, p, ref, n, reps);
+
+      if (cpu_avx2)
+	{
+	  bench_scale("scale_avx2", scale_avx2, p, ref, n, reps);
+	  bench_scale("scale_avx2_nt", scale_avx2_nt, p, ref, n, reps);
+	}
+
+      if (cpu_avx512f)
+	{
+	  bench_scale("scale_avx512", scale_avx512, p, ref, n, reps);
+	  bench_scale("scale_avx512_nt", scale_avx512_nt, p, ref, n, reps);
+	}
+
+      bench_scale("scale", scale, p, ref, n, reps);
+      
+      free(p);
+      free(ref);
+      
+      return 0;
+    }
 
   //程序将命令行参数argv[1]（第二个参数）转换为无符号长整数类型 n，表示数组的大小；
   unsigned long long n = atoi(argv[1]);
@@ -98,6 +405,20 @@ int main(int argc, char **argv)
 
   putchar('\n');
 
+  // ==== SIMD ====
+  printf("\t== SIMD ==\n");
+
+  for (unsigned long long i = 0; i < n; i++)
+    p[i] = i + 1;
+
+  //Scale the vector by s with the variant picked at startup
+  scale(p, n, s);
+
+  for (unsigned long long i = 0; i < n; i++)
+    printf("%5d%c", p[i], ((i + 1) % 10) ? '\t' : '\n');
+
+  putchar('\n');
+
   //释放动态分配的内存（数组 p）并返回0，表示成功执行。
   free(p);
   
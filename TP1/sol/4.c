@@ -1,6 +1,15 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+//
+typedef unsigned char      u8;
+typedef signed char        i8;
+typedef short              i16;
+typedef unsigned long long u64;
 
 //计算两个整数数组 a 和 b 的点积（dot product）
 //整数指针 a，表示第一个整数数组；整数指针 b，表示第二个整数数组；无符号长整数 n，表示数组的大小。
@@ -62,12 +71,718 @@ long long dotprod_asm(int *a, int *b, unsigned long long n)
   return d;
 } //这个函数使用内联汇编优化了点积的计算，可以提高对大型数据集的计算性能。
 
+//Reference with 64-bit products and accumulation (dotprod_c multiplies in
+//32 bits, dotprod_asm also accumulates in 32 bits)
+long long dotprod_c64(int *a, int *b, unsigned long long n)
+{
+  long long d = 0;
+
+  for (unsigned long long i = 0; i < n; i++)
+    d += (long long)a[i] * b[i];
+
+  return d;
+}
+
+//AVX2: vpmuldq multiplies the even 32-bit lanes into 64-bit products, the odd
+//lanes are shifted down to get the other half. 2 x 8 ints per iteration.
+__attribute__((target("avx2")))
+long long dotprod_avx2(int *a, int *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  __m256i acc2 = _mm256_setzero_si256();
+  __m256i acc3 = _mm256_setzero_si256();
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m256i a0 = _mm256_loadu_si256((__m256i *)(a + i));
+      __m256i b0 = _mm256_loadu_si256((__m256i *)(b + i));
+      __m256i a1 = _mm256_loadu_si256((__m256i *)(a + i + 8));
+      __m256i b1 = _mm256_loadu_si256((__m256i *)(b + i + 8));
+
+      acc0 = _mm256_add_epi64(acc0, _mm256_mul_epi32(a0, b0));
+      acc1 = _mm256_add_epi64(acc1, _mm256_mul_epi32(_mm256_srli_epi64(a0, 32), _mm256_srli_epi64(b0, 32)));
+      acc2 = _mm256_add_epi64(acc2, _mm256_mul_epi32(a1, b1));
+      acc3 = _mm256_add_epi64(acc3, _mm256_mul_epi32(_mm256_srli_epi64(a1, 32), _mm256_srli_epi64(b1, 32)));
+    }
+
+  long long t[4];
+
+  _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(_mm256_add_epi64(acc0, acc1), _mm256_add_epi64(acc2, acc3)));
+
+  return t[0] + t[1] + t[2] + t[3] + dotprod_c64(a + i, b + i, n - i);
+}
+
+//AVX-512: same scheme on 16 ints per vector, masked tail
+__attribute__((target("avx512f")))
+long long dotprod_avx512(int *a, int *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m512i acc0 = _mm512_setzero_si512();
+  __m512i acc1 = _mm512_setzero_si512();
+  __m512i acc2 = _mm512_setzero_si512();
+  __m512i acc3 = _mm512_setzero_si512();
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m512i a0 = _mm512_loadu_si512(a + i);
+      __m512i b0 = _mm512_loadu_si512(b + i);
+      __m512i a1 = _mm512_loadu_si512(a + i + 16);
+      __m512i b1 = _mm512_loadu_si512(b + i + 16);
+
+      acc0 = _mm512_add_epi64(acc0, _mm512_mul_epi32(a0, b0));
+      acc1 = _mm512_add_epi64(acc1, _mm512_mul_epi32(_mm512_srli_epi64(a0, 32), _mm512_srli_epi64(b0, 32)));
+      acc2 = _mm512_add_epi64(acc2, _mm512_mul_epi32(a1, b1));
+      acc3 = _mm512_add_epi64(acc3, _mm512_mul_epi32(_mm512_srli_epi64(a1, 32), _mm512_srli_epi64(b1, 32)));
+    }
+
+  //Up to 2 masked vectors (masked out lanes load 0)
+  for (; i < n; i += 16)
+    {
+      __mmask16 m = (n - i >= 16) ? 0xFFFF : (1U << (n - i)) - 1;
+      __m512i a0 = _mm512_maskz_loadu_epi32(m, a + i);
+      __m512i b0 = _mm512_maskz_loadu_epi32(m, b + i);
+
+      acc0 = _mm512_add_epi64(acc0, _mm512_mul_epi32(a0, b0));
+      acc1 = _mm512_add_epi64(acc1, _mm512_mul_epi32(_mm512_srli_epi64(a0, 32), _mm512_srli_epi64(b0, 32)));
+    }
+
+  return _mm512_reduce_add_epi64(_mm512_add_epi64(_mm512_add_epi64(acc0, acc1), _mm512_add_epi64(acc2, acc3)));
+}
+
+//
+// int16: vpmaddwd multiplies 16-bit pairs and adds them into 32-bit lanes,
+// each result is widened to 64 bits. Inputs must be in [-32767, 32767]:
+// two -32768 * -32768 products in one pair wrap the 32-bit lane.
+//
+
+//
+long long dotprod16_c(i16 *a, i16 *b, unsigned long long n)
+{
+  long long d = 0;
+
+  for (unsigned long long i = 0; i < n; i++)
+    d += (int)a[i] * b[i];
+
+  return d;
+}
+
+//
+__attribute__((target("avx2")))
+long long dotprod16_avx2(i16 *a, i16 *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m256i p = _mm256_madd_epi16(_mm256_loadu_si256((__m256i *)(a + i)),
+				    _mm256_loadu_si256((__m256i *)(b + i)));
+
+      acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+      acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+
+  long long t[4];
+
+  _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(acc0, acc1));
+
+  return t[0] + t[1] + t[2] + t[3] + dotprod16_c(a + i, b + i, n - i);
+}
+
+//
+__attribute__((target("avx512f,avx512bw")))
+long long dotprod16_avx512(i16 *a, i16 *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m512i acc0 = _mm512_setzero_si512();
+  __m512i acc1 = _mm512_setzero_si512();
+
+  for (; i < n; i += 32)
+    {
+      __mmask32 m = (n - i >= 32) ? 0xFFFFFFFF : (1U << (n - i)) - 1;
+      __m512i p = _mm512_madd_epi16(_mm512_maskz_loadu_epi16(m, a + i), _mm512_maskz_loadu_epi16(m, b + i));
+
+      acc0 = _mm512_add_epi64(acc0, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(p)));
+      acc1 = _mm512_add_epi64(acc1, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(p, 1)));
+    }
+
+  return _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+//
+// int8: unsigned 8-bit activations times signed 8-bit weights
+//
+
+//
+long long dotprod8_c(u8 *a, i8 *b, unsigned long long n)
+{
+  long long d = 0;
+
+  for (unsigned long long i = 0; i < n; i++)
+    d += (int)a[i] * b[i];
+
+  return d;
+}
+
+//Fallback without VNNI: both operands are widened to 16 bits (vpmaddubsw
+//would saturate on 255 * 127 * 2) and go through vpmaddwd
+__attribute__((target("avx2")))
+long long dotprod8_avx2(u8 *a, i8 *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+
+  for (; i + 16 <= n; i += 16)
+    {
+      __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(a + i)));
+      __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((__m128i *)(b + i)));
+      __m256i p  = _mm256_madd_epi16(va, vb);
+
+      acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+      acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+
+  long long t[4];
+
+  _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(acc0, acc1));
+
+  return t[0] + t[1] + t[2] + t[3] + dotprod8_c(a + i, b + i, n - i);
+}
+
+//Rounds of vpdpbusd accumulated in 32 bits before widening: one round adds at
+//most 4 * 255 * 128 per lane, 4096 rounds stay below 2^31
+#define VNNI_FLUSH 4096
+
+//VNNI: vpdpbusd multiplies 4 u8 x s8 pairs and adds them to each 32-bit lane
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+long long dotprod8_vnni(u8 *a, i8 *b, unsigned long long n)
+{
+  u64 i = 0;
+  __m512i acc = _mm512_setzero_si512();
+
+  while (i < n)
+    {
+      __m512i acc32 = _mm512_setzero_si512();
+      
+      for (u64 r = 0; r < VNNI_FLUSH && i < n; r++, i += 64)
+	{
+	  __mmask64 m = (n - i >= 64) ? ~0ULL : (1ULL << (n - i)) - 1;
+
+	  acc32 = _mm512_dpbusd_epi32(acc32, _mm512_maskz_loadu_epi8(m, a + i), _mm512_maskz_loadu_epi8(m, b + i));
+	}
+
+      acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(acc32)));
+      acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(acc32, 1)));
+    }
+
+  return _mm512_reduce_add_epi64(acc);
+}
+
+//Dispatchers: widest version supported by the CPU
+long long dotprod(int *a, int *b, unsigned long long n)
+{
+  if (__builtin_cpu_supports("avx512f"))
+    return dotprod_avx512(a, b, n);
+
+  if (__builtin_cpu_supports("avx2"))
+    return dotprod_avx2(a, b, n);
+
+  return dotprod_c64(a, b, n);
+}
+
+//
+long long dotprod16(i16 *a, i16 *b, unsigned long long n)
+{
+  if (__builtin_cpu_supports("avx512bw"))
+    return dotprod16_avx512(a, b, n);
+
+  if (__builtin_cpu_supports("avx2"))
+    return dotprod16_avx2(a, b, n);
+
+  return dotprod16_c(a, b, n);
+}
+
+//
+long long dotprod8(u8 *a, i8 *b, unsigned long long n)
+{
+  if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+    return dotprod8_vnni(a, b, n);
+
+  if (__builtin_cpu_supports("avx2"))
+    return dotprod8_avx2(a, b, n);
+
+  return dotprod8_c(a, b, n);
+}
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//
+// Matrix products on top of the dot products. Matrices are row-major,
+// A is m x k, B is k x n, C is m x n with 64-bit entries.
+//
+
+//Cache tiling: a KC x NC tile of B is packed transposed (columns contiguous)
+//so it stays in L2, the 4 packed columns used by the microkernel (4 * KC ints)
+//stay in L1 while it walks down MC rows of A
+#define GEMM_KC 256
+#define GEMM_NC 256
+#define GEMM_MC 64
+
+//Sum of the 4 64-bit lanes
+__attribute__((target("avx2")))
+static inline long long hsum_epi64(__m256i v)
+{
+  __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+  return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+}
+
+//Register blocked microkernel: a 2 x 4 block of C gets the dot products of
+//2 rows of A with 4 packed columns of B over kc elements. The ints are sign
+//extended to 64-bit lanes so a single vpmuldq gives 4 exact products;
+//8 accumulators + 2 A + 4 B vectors fit the 16 ymm registers.
+__attribute__((target("avx2")))
+static void ukernel32_2x4(int *a, u64 lda, int *b, u64 ldb, u64 kc, long long *c, u64 ldc)
+{
+  __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+  __m256i c02 = _mm256_setzero_si256(), c03 = _mm256_setzero_si256();
+  __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+  __m256i c12 = _mm256_setzero_si256(), c13 = _mm256_setzero_si256();
+  u64 p = 0;
+
+#define LD32(x) _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *)(x)))
+  
+  for (; p + 4 <= kc; p += 4)
+    {
+      __m256i a0 = LD32(a + p);
+      __m256i a1 = LD32(a + lda + p);
+      __m256i b0 = LD32(b + p);
+      __m256i b1 = LD32(b + ldb + p);
+      __m256i b2 = LD32(b + (2 * ldb) + p);
+      __m256i b3 = LD32(b + (3 * ldb) + p);
+
+      c00 = _mm256_add_epi64(c00, _mm256_mul_epi32(a0, b0));
+      c01 = _mm256_add_epi64(c01, _mm256_mul_epi32(a0, b1));
+      c02 = _mm256_add_epi64(c02, _mm256_mul_epi32(a0, b2));
+      c03 = _mm256_add_epi64(c03, _mm256_mul_epi32(a0, b3));
+      c10 = _mm256_add_epi64(c10, _mm256_mul_epi32(a1, b0));
+      c11 = _mm256_add_epi64(c11, _mm256_mul_epi32(a1, b1));
+      c12 = _mm256_add_epi64(c12, _mm256_mul_epi32(a1, b2));
+      c13 = _mm256_add_epi64(c13, _mm256_mul_epi32(a1, b3));
+    }
+
+#undef LD32
+
+  u64 r = kc - p;
+  
+  c[0]       += hsum_epi64(c00) + dotprod_c64(a + p, b + p, r);
+  c[1]       += hsum_epi64(c01) + dotprod_c64(a + p, b + ldb + p, r);
+  c[2]       += hsum_epi64(c02) + dotprod_c64(a + p, b + (2 * ldb) + p, r);
+  c[3]       += hsum_epi64(c03) + dotprod_c64(a + p, b + (3 * ldb) + p, r);
+  c[ldc]     += hsum_epi64(c10) + dotprod_c64(a + lda + p, b + p, r);
+  c[ldc + 1] += hsum_epi64(c11) + dotprod_c64(a + lda + p, b + ldb + p, r);
+  c[ldc + 2] += hsum_epi64(c12) + dotprod_c64(a + lda + p, b + (2 * ldb) + p, r);
+  c[ldc + 3] += hsum_epi64(c13) + dotprod_c64(a + lda + p, b + (3 * ldb) + p, r);
+}
+
+//int16 microkernel: vpmaddwd on 16 elements, the 8 pair sums are widened and
+//folded into one 64-bit accumulator per entry of the 2 x 4 block. Same input
+//range as dotprod16: [-32767, 32767].
+__attribute__((target("avx2")))
+static void ukernel16_2x4(i16 *a, u64 lda, i16 *b, u64 ldb, u64 kc, long long *c, u64 ldc)
+{
+  __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+  __m256i c02 = _mm256_setzero_si256(), c03 = _mm256_setzero_si256();
+  __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+  __m256i c12 = _mm256_setzero_si256(), c13 = _mm256_setzero_si256();
+  u64 p = 0;
+
+#define LD16(x) _mm256_loadu_si256((__m256i *)(x))
+#define MADD(acc, x, y)							\
+  do									\
+    {									\
+      __m256i _p = _mm256_madd_epi16((x), (y));				\
+									\
+      acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(_p)), \
+						   _mm256_cvtepi32_epi64(_mm256_extracti128_si256(_p, 1)))); \
+    }									\
+  while (0)
+  
+  for (; p + 16 <= kc; p += 16)
+    {
+      __m256i a0 = LD16(a + p);
+      __m256i a1 = LD16(a + lda + p);
+      __m256i b0 = LD16(b + p);
+      __m256i b1 = LD16(b + ldb + p);
+      __m256i b2 = LD16(b + (2 * ldb) + p);
+      __m256i b3 = LD16(b + (3 * ldb) + p);
+
+      MADD(c00, a0, b0); MADD(c01, a0, b1); MADD(c02, a0, b2); MADD(c03, a0, b3);
+      MADD(c10, a1, b0); MADD(c11, a1, b1); MADD(c12, a1, b2); MADD(c13, a1, b3);
+    }
+
+#undef MADD
+#undef LD16
+
+  u64 r = kc - p;
+  
+  c[0]       += hsum_epi64(c00) + dotprod16_c(a + p, b + p, r);
+  c[1]       += hsum_epi64(c01) + dotprod16_c(a + p, b + ldb + p, r);
+  c[2]       += hsum_epi64(c02) + dotprod16_c(a + p, b + (2 * ldb) + p, r);
+  c[3]       += hsum_epi64(c03) + dotprod16_c(a + p, b + (3 * ldb) + p, r);
+  c[ldc]     += hsum_epi64(c10) + dotprod16_c(a + lda + p, b + p, r);
+  c[ldc + 1] += hsum_epi64(c11) + dotprod16_c(a + lda + p, b + ldb + p, r);
+  c[ldc + 2] += hsum_epi64(c12) + dotprod16_c(a + lda + p, b + (2 * ldb) + p, r);
+  c[ldc + 3] += hsum_epi64(c13) + dotprod16_c(a + lda + p, b + (3 * ldb) + p, r);
+}
+
+//Tiled GEMM driver for element type T: packs each KC x NC tile of B transposed,
+//runs the 2 x 4 microkernel over MC row blocks of A, and finishes the edges
+//(and CPUs without AVX2) with plain dot products.
+#define GEMM_DRIVER(name, T, ukernel, dot)				\
+  void name(T *A, T *B, long long *C, u64 m, u64 n, u64 k)		\
+  {									\
+    T *bt = aligned_alloc(64, sizeof(T) * GEMM_KC * GEMM_NC);		\
+    int simd = __builtin_cpu_supports("avx2");				\
+									\
+    if (!bt)								\
+      printf("Error: cannot allocate packing buffer\n"), exit(-1);	\
+									\
+    memset(C, 0, sizeof(long long) * m * n);				\
+									\
+    for (u64 jc = 0; jc < n; jc += GEMM_NC)				\
+      {									\
+	u64 nc = (n - jc < GEMM_NC) ? n - jc : GEMM_NC;			\
+									\
+	for (u64 pc = 0; pc < k; pc += GEMM_KC)				\
+	  {								\
+	    u64 kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;		\
+									\
+	    /* Pack: bt[j][p] = B[pc + p][jc + j] */			\
+	    for (u64 p = 0; p < kc; p++)				\
+	      for (u64 j = 0; j < nc; j++)				\
+		bt[(j * kc) + p] = B[((pc + p) * n) + jc + j];		\
+									\
+	    for (u64 ic = 0; ic < m; ic += GEMM_MC)			\
+	      {								\
+		u64 mc = (m - ic < GEMM_MC) ? m - ic : GEMM_MC;		\
+									\
+		for (u64 jr = 0; jr < nc; jr += 4)			\
+		  for (u64 ir = 0; ir < mc; ir += 2)			\
+		    {							\
+		      T *a = A + ((ic + ir) * k) + pc;			\
+		      T *b = bt + (jr * kc);				\
+		      long long *c = C + ((ic + ir) * n) + jc + jr;	\
+									\
+		      if (simd && jr + 4 <= nc && ir + 2 <= mc)		\
+			ukernel(a, k, b, kc, kc, c, n);			\
+		      else						\
+			for (u64 i = 0; i < 2 && ir + i < mc; i++)	\
+			  for (u64 j = 0; j < 4 && jr + j < nc; j++)	\
+			    c[(i * n) + j] += dot(a + (i * k), b + (j * kc), kc); \
+		    }							\
+	      }								\
+	  }								\
+      }									\
+									\
+    free(bt);								\
+  }
+
+GEMM_DRIVER(gemm32, int, ukernel32_2x4, dotprod_c64)
+GEMM_DRIVER(gemm16, i16, ukernel16_2x4, dotprod16_c)
+
+//Row by row reference: B is transposed once, then one dot product per entry
+void gemm32_naive(int *A, int *B, long long *C, u64 m, u64 n, u64 k)
+{
+  int *bt = malloc(sizeof(int) * k * n);
+
+  if (!bt)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 p = 0; p < k; p++)
+    for (u64 j = 0; j < n; j++)
+      bt[(j * k) + p] = B[(p * n) + j];
+  
+  for (u64 i = 0; i < m; i++)
+    for (u64 j = 0; j < n; j++)
+      C[(i * n) + j] = dotprod_c64(A + (i * k), bt + (j * k), k);
+
+  free(bt);
+}
+
+//4 rows of A against the same chunk of x: each x vector feeds 4 products
+__attribute__((target("avx2")))
+static void ukernel32_gemv4(int *a, u64 lda, int *x, u64 kc, long long *y)
+{
+  __m256i y0 = _mm256_setzero_si256(), y1 = _mm256_setzero_si256();
+  __m256i y2 = _mm256_setzero_si256(), y3 = _mm256_setzero_si256();
+  u64 p = 0;
+
+#define LD32(v) _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *)(v)))
+  
+  for (; p + 4 <= kc; p += 4)
+    {
+      __m256i vx = LD32(x + p);
+
+      y0 = _mm256_add_epi64(y0, _mm256_mul_epi32(LD32(a + p), vx));
+      y1 = _mm256_add_epi64(y1, _mm256_mul_epi32(LD32(a + lda + p), vx));
+      y2 = _mm256_add_epi64(y2, _mm256_mul_epi32(LD32(a + (2 * lda) + p), vx));
+      y3 = _mm256_add_epi64(y3, _mm256_mul_epi32(LD32(a + (3 * lda) + p), vx));
+    }
+
+#undef LD32
+
+  u64 r = kc - p;
+  
+  y[0] += hsum_epi64(y0) + dotprod_c64(a + p, x + p, r);
+  y[1] += hsum_epi64(y1) + dotprod_c64(a + lda + p, x + p, r);
+  y[2] += hsum_epi64(y2) + dotprod_c64(a + (2 * lda) + p, x + p, r);
+  y[3] += hsum_epi64(y3) + dotprod_c64(a + (3 * lda) + p, x + p, r);
+}
+
+//y = A x, A is m x k. x is consumed in KC chunks that stay in L1 while all
+//the rows go through them, 4 rows at a time.
+void gemv32(int *A, int *x, long long *y, u64 m, u64 k)
+{
+  int simd = __builtin_cpu_supports("avx2");
+  
+  memset(y, 0, sizeof(long long) * m);
+
+  for (u64 pc = 0; pc < k; pc += GEMM_KC)
+    {
+      u64 kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+      u64 i = 0;
+
+      if (simd)
+	for (; i + 4 <= m; i += 4)
+	  ukernel32_gemv4(A + (i * k) + pc, k, x + pc, kc, y + i);
+
+      for (; i < m; i++)
+	y[i] += dotprod_c64(A + (i * k) + pc, x + pc, kc);
+    }
+}
+
+//Row by row reference
+void gemv32_naive(int *A, int *x, long long *y, u64 m, u64 k)
+{
+  for (u64 i = 0; i < m; i++)
+    y[i] = dotprod_c64(A + (i * k), x, k);
+}
+
+//GOPS (a multiply and an add per inner step) of the GEMM and GEMV versions on
+//square sizes from 64 up to max
+void bench_gemm(u64 max)
+{
+  int *A = malloc(sizeof(int) * max * max);
+  int *B = malloc(sizeof(int) * max * max);
+  i16 *A16 = malloc(sizeof(i16) * max * max);
+  i16 *B16 = malloc(sizeof(i16) * max * max);
+  long long *C = malloc(sizeof(long long) * max * max);
+  long long *R = malloc(sizeof(long long) * max * max);
+
+  if (!A || !B || !A16 || !B16 || !C || !R)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  //int32 values in [-2^e, 2^e] so that the k <= max products of an entry
+  //fit the 64-bit accumulators (same bound as the dot product bench), int16
+  //values in the vpmaddwd safe range
+  int lg = 64 - __builtin_clzll(max | 1), e = (62 - lg) / 2;
+
+  e = (e > 30) ? 30 : e;
+  srand(0);
+
+  for (u64 i = 0; i < max * max; i++)
+    {
+      A[i] = (int)((((u64)rand() << 31) ^ rand()) % ((2ULL << e) + 1)) - (1 << e);
+      B[i] = (int)((((u64)rand() << 31) ^ rand()) % ((2ULL << e) + 1)) - (1 << e);
+      A16[i] = (rand() % 65535) - 32767;
+      B16[i] = (rand() % 65535) - 32767;
+    }
+
+  printf("%6s %12s %12s %12s %12s %12s\n", "size", "naive", "gemm32", "gemm16", "gemv naive", "gemv32");
+  
+  for (u64 s = 64; s <= max; s *= 2)
+    {
+      double ops = 2.0 * s * s * s;
+      double b, a, e_n, e_32, e_16, e_vn, e_v;
+      int ok = 1;
+
+      b = now(); gemm32_naive(A, B, R, s, s, s); a = now(); e_n = a - b;
+      b = now(); gemm32(A, B, C, s, s, s);       a = now(); e_32 = a - b;
+
+      ok &= !memcmp(C, R, sizeof(long long) * s * s);
+
+      //int16 reference: naive dot products on the same packing
+      b = now(); gemm16(A16, B16, C, s, s, s); a = now(); e_16 = a - b;
+
+      for (u64 i = 0; i < s && ok; i++)
+	for (u64 j = 0; j < s; j++)
+	  {
+	    long long d = 0;
+
+	    for (u64 p = 0; p < s; p++)
+	      d += (int)A16[(i * s) + p] * B16[(p * s) + j];
+
+	    if (d != C[(i * s) + j])
+	      {
+		ok = 0;
+		break;
+	      }
+	  }
+
+      //GEMV, repeated to get a measurable time
+      u64 reps = 1 + (1ULL << 24) / (s * s);
+
+      b = now();
+      
+      for (u64 r = 0; r < reps; r++)
+	gemv32_naive(A, B, R, s, s);
+
+      a = now(); e_vn = (a - b) / reps;
+      b = now();
+      
+      for (u64 r = 0; r < reps; r++)
+	gemv32(A, B, C, s, s);
+
+      a = now(); e_v = (a - b) / reps;
+      
+      ok &= !memcmp(C, R, sizeof(long long) * s);
+      
+      printf("%6llu %12.3lf %12.3lf %12.3lf %12.3lf %12.3lf GOPS %s\n", s,
+	     ops / e_n / 1e9, ops / e_32 / 1e9, ops / e_16 / 1e9,
+	     2.0 * s * s / e_vn / 1e9, 2.0 * s * s / e_v / 1e9, ok ? "" : "(MISMATCH)");
+    }
+
+  free(A); free(B); free(A16); free(B16); free(C); free(R);
+}
+
+//Runs f reps times, prints GB/s (bytes of both operands) and checks the result
+#define BENCH_DOT(name, f, a, b, n, reps, ref)				\
+  do									\
+    {									\
+      long long _d = 0;							\
+      __typeof__(&f) volatile _f = f; /* Keeps the calls in the loop */ \
+      double _b = now();						\
+									\
+      for (u64 _r = 0; _r < (reps); _r++)				\
+	_d = _f((a), (b), (n));						\
+									\
+      double _a = now();						\
+									\
+      printf("%-18s: %22lld, %8.2lf GB/s %s\n", (name), _d,		\
+	     (sizeof(*(a)) + sizeof(*(b))) * (double)(n) * (reps) / (_a - _b) / 1e9, \
+	     (_d != (ref)) ? "(MISMATCH)" : "");			\
+    }									\
+  while (0)
+
 //演示和比较使用C语言和内联汇编语言编写的点积（dot product）计算功能
 int main(int argc, char **argv)
 {
   //程序检查命令行参数的数量，如果少于2个参数（程序名和n），则打印使用说明并返回1，表示出现了错误。
   if (argc < 2)
-    return printf("Usage: %s [n]\n", argv[0]), 1;
+    return printf("Usage: %s [n]\n"
+		  "       %s bench [n] [reps]\n"
+		  "       %s gemm [max size]\n", argv[0], argv[0], argv[0]), 1;
+
+  //Matrix products across sizes
+  if (!strcmp(argv[1], "gemm"))
+    {
+      u64 max = (argc > 2) ? atoll(argv[2]) : 1024;
+
+      if (max < 64)
+	return printf("Error: max size must be >= 64\n"), 2;
+
+      bench_gemm(max);
+
+      return 0;
+    }
+
+  //int32, int16 and int8 versions on random data
+  if (!strcmp(argv[1], "bench") && argc > 2)
+    {
+      u64 n    = atoll(argv[2]);
+      u64 reps = (argc > 3) ? atoll(argv[3]) : 1 + (1ULL << 28) / (n + 1);
+
+      int *a   = malloc(sizeof(int) * n);
+      int *b   = malloc(sizeof(int) * n);
+      i16 *a16 = malloc(sizeof(i16) * n);
+      i16 *b16 = malloc(sizeof(i16) * n);
+      u8  *a8  = malloc(sizeof(u8) * n);
+      i8  *b8  = malloc(sizeof(i8) * n);
+      
+      if (!a || !b || !a16 || !b16 || !a8 || !b8)
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      //int32 values in [-2^e, 2^e] with n < 2^lg and e = (62 - lg) / 2: the
+      //products overflow 32 bits (e >= 17) but their sum still fits the
+      //64-bit reference
+      int lg = 64 - __builtin_clzll(n | 1), e = (62 - lg) / 2;
+
+      if (e < 17)
+	return printf("Error: n must be < 2^28 for an exact 64-bit reference\n"), 2;
+
+      e = (e > 30) ? 30 : e;
+      srand(0);
+      
+      for (u64 i = 0; i < n; i++)
+	{
+	  a[i]   = (int)((((u64)rand() << 31) ^ rand()) % ((2ULL << e) + 1)) - (1 << e);
+	  b[i]   = (int)((((u64)rand() << 31) ^ rand()) % ((2ULL << e) + 1)) - (1 << e);
+	  a16[i] = (rand() % 65535) - 32767;
+	  b16[i] = (rand() % 65535) - 32767;
+	  a8[i]  = rand();
+	  b8[i]  = rand();
+	}
+
+      long long r32 = dotprod_c64(a, b, n);
+      long long r16 = dotprod16_c(a16, b16, n);
+      long long r8  = dotprod8_c(a8, b8, n);
+
+      printf("n: %llu, reps: %llu\n", n, reps);
+      
+      BENCH_DOT("dotprod_c", dotprod_c, a, b, n, reps, r32);
+      BENCH_DOT("dotprod_c64", dotprod_c64, a, b, n, reps, r32);
+
+      if (__builtin_cpu_supports("avx2"))
+	BENCH_DOT("dotprod_avx2", dotprod_avx2, a, b, n, reps, r32);
+
+      if (__builtin_cpu_supports("avx512f"))
+	BENCH_DOT("dotprod_avx512", dotprod_avx512, a, b, n, reps, r32);
+
+      BENCH_DOT("dotprod16_c", dotprod16_c, a16, b16, n, reps, r16);
+
+      if (__builtin_cpu_supports("avx2"))
+	BENCH_DOT("dotprod16_avx2", dotprod16_avx2, a16, b16, n, reps, r16);
+
+      if (__builtin_cpu_supports("avx512bw"))
+	BENCH_DOT("dotprod16_avx512", dotprod16_avx512, a16, b16, n, reps, r16);
+
+      BENCH_DOT("dotprod8_c", dotprod8_c, a8, b8, n, reps, r8);
+
+      if (__builtin_cpu_supports("avx2"))
+	BENCH_DOT("dotprod8_avx2", dotprod8_avx2, a8, b8, n, reps, r8);
+
+      if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+	BENCH_DOT("dotprod8_vnni", dotprod8_vnni, a8, b8, n, reps, r8);
+
+      free(a); free(b);
+      free(a16); free(b16);
+      free(a8); free(b8);
+      
+      return 0;
+    }
 
   //程序将命令行参数argv[1]（第二个参数）转换为无符号长整数类型 n，表示要计算点积的数组的大小。
   unsigned long long n = atoll(argv[1]);
@@ -109,6 +824,9 @@ int main(int argc, char **argv)
   //Print vector
   printf("dotprod_asm: %lld\n", d_asm);
 
+  //64-bit accumulation, exact even when the 32-bit versions overflow
+  printf("dotprod    : %lld\n", dotprod(a, b, n));
+
   //释放动态分配的内存（数组 a 和 b）并返回0，表示成功执行。
   free(a);
   free(b);
@@ -1,326 +1,808 @@
 //hamming distance between DNA chaines
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <immintrin.h>
 
-//Defining error codes
-#define ERR_FNAME_NULL   0
-#define ERR_MALLOC_NULL  1
-#define ERR_STAT         3
-#define ERR_OPEN_FILE    4
-#define ERR_READ_BYTES   5
-#define ERR_NULL_POINTER 6
+#include "dna2.h"
+#include "seq.h"
+#include "hamming.h"
 
 //
 #define REPS 10000000
 
+//Packed 2-bit sequence, see dna2.h
+typedef struct {
+
+  //4 bases per byte
+  u8 *bits;
+
+  //Number of bases
+  u64 len;
+  
+} pseq_t;
+
+//Packs n ascii bases into (n + 3) / 4 bytes
+void pack_c(u8 *dst, u8 *src, u64 n)
+{
+  memset(dst, 0, (n + 3) / 4);
+  
+  for (u64 i = 0; i < n; i++)
+    dst[i >> 2] |= DNA2_CODE(src[i]) << (2 * (i & 3));
+}
+
+//32 bases -> 8 bytes: codes come from a shift and a mask, vpmaddubsw and
+//vpmaddwd weigh each group of 4 codes by 1, 4, 16, 64, and the low byte of
+//every dword is gathered with vpshufb + vpermd
+__attribute__((target("avx2")))
+void pack_avx2(u8 *dst, u8 *src, u64 n)
+{
+  const __m256i three = _mm256_set1_epi8(3);
+  const __m256i w8    = _mm256_set1_epi16(0x0401);
+  const __m256i w16   = _mm256_set1_epi32(0x00100001);
+  const __m256i gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+					  0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+  u64 i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((__m256i *)(src + i));
+      __m256i c = _mm256_and_si256(_mm256_srli_epi16(v, 1), three);
+
+      c = _mm256_madd_epi16(_mm256_maddubs_epi16(c, w8), w16);
+      c = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(c, gather), lanes);
+
+      _mm_storel_epi64((__m128i *)(dst + (i >> 2)), _mm256_castsi256_si128(c));
+    }
+
+  pack_c(dst + (i >> 2), src + i, n - i);
+}
+
+//Packed view of a loaded file: DNA2 files are copied, text is converted
+//(trailing newline excluded)
+pseq_t *pack_seq(seq_t *s)
+{
+  if (!s)
+    {
+      err_id = ERR_NULL_POINTER;
+      return NULL;
+    }
+
+  pseq_t *p = malloc(sizeof(pseq_t));
+
+  if (!p)
+    {
+      err_id = ERR_MALLOC_NULL;
+      return NULL;
+    }
+
+  if (s->len >= DNA2_HDR && !memcmp(s->bases, DNA2_MAGIC, 8))
+    {
+      memcpy(&p->len, s->bases + 8, sizeof(u64));
+
+      if (s->len - DNA2_HDR != (p->len + 3) / 4)
+	{
+	  err_id = ERR_READ_BYTES;
+	  return free(p), NULL;
+	}
+    }
+  else
+    {
+      p->len = s->len;
+
+      while (p->len && (s->bases[p->len - 1] == '\n' || s->bases[p->len - 1] == '\r'))
+	p->len--;
+    }
+
+  p->bits = malloc((p->len + 3) / 4);
+
+  if (!p->bits)
+    {
+      err_id = ERR_MALLOC_NULL;
+      return free(p), NULL;
+    }
+
+  if (s->len >= DNA2_HDR && !memcmp(s->bases, DNA2_MAGIC, 8))
+    memcpy(p->bits, s->bases + DNA2_HDR, (p->len + 3) / 4);
+  else
+    if (__builtin_cpu_supports("avx2"))
+      pack_avx2(p->bits, s->bases, p->len);
+    else
+      pack_c(p->bits, s->bases, p->len);
+  
+  return p;
+}
+
 //
-typedef unsigned char      u8;
-typedef unsigned long long u64;
+void release_pseq(pseq_t *p)
+{
+  if (p)
+    {
+      free(p->bits);
+      p->bits = NULL;
+      p->len = 0;
+    }
+  else
+    err_id = ERR_NULL_POINTER;
+}
 
-//Sequence definitions 
-typedef struct {
+//Base mismatches on text, the reference for the packed kernels
+u64 mismatch_c(u8 *a, u8 *b, u64 n)
+{
+  u64 m = 0;
 
-  //Sequence elements/bytes
-  u8 *bases;  //这是一个 u8 指针，用于存储序列的元素或字节数据。可以被视为一个指向字节数组的指针。
+  for (u64 i = 0; i < n; i++)
+    m += (a[i] != b[i]);
 
-  //Sequence length
-  u64 len;    //表示序列的长度，即序列中包含的元素或字节的数量。
+  return m;
+}
 
-} seq_t; //这是一个用户定义的结构体，用于表示序列数据。
-//使用这些类型和结构体，您可以创建和操作序列数据，其中 seq_t 结构体包含了序列的元素和长度信息。
-//这种抽象的表示使得处理序列数据更加灵活和可维护，可以方便地传递和操作序列数据。
+//Base mismatches on packed data: a 2-bit lane differs if either of its bits
+//does, (x | x >> 1) & 0x55.. leaves one bit per differing base. The unused
+//bits of the last byte are 0 on both sides and never count.
+u64 mismatch_packed_c(u8 *a, u8 *b, u64 len)
+{
+  u64 n = (len + 3) / 4, m = 0, i = 0;
 
+  for (; i + 8 <= n; i += 8)
+    {
+      u64 x, y;
 
-//Global error variable
-u64 err_id = 0;
+      memcpy(&x, a + i, 8);
+      memcpy(&y, b + i, 8);
 
-//Error messages
-const char *err_msg[] = {
+      x ^= y;
+      m += __builtin_popcountll((x | (x >> 1)) & 0x5555555555555555ULL);
+    }
 
-  "file name pointer NULL",
-  "memory allocation fail, 'malloc' returned NULL",
-  "cannot 'stat' file",
-  "cannot open file, 'fopen' returned NULL",
-  "mismatch between read bytes and file length",
+  for (; i < n; i++)
+    {
+      u8 x = a[i] ^ b[i];
+      
+      m += __builtin_popcount((x | (x >> 1)) & 0x55);
+    }
   
-  NULL
-};
+  return m;
+}
 
-//这是一个用于获取时间戳计数（TSC，Time Stamp Counter）值的内联汇编函数。
-//TSC是一个CPU寄存器，通常用于度量CPU执行指令的时钟周期数，以测量程序执行时间和性能。
-static inline u64 rdtsc()
+//Same on 128 bases per iteration, counted with the nibble LUT
+__attribute__((target("avx2")))
+u64 mismatch_packed_avx2(u8 *a, u8 *b, u64 len)
 {
-  u64 a, d;  //声明两个64位无符号整数变量 a 和 d，用于存储TSC值的低32位和高32位。
+  const __m256i m55 = _mm256_set1_epi8(0x55);
+  u64 n = (len + 3) / 4, i = 0;
+  __m256i acc = _mm256_setzero_si256();
   
-  __asm__ volatile ("rdtsc" : "=a" (a), "=d" (d)); 
-  //这是内联汇编代码，执行了RDTSC（Read Time-Stamp Counter）指令，该指令将TSC的值读入寄存器EAX和EDX。
-  //内联汇编使用了扩展的内联汇编语法，其中 "rdtsc" 是汇编指令，"=a" 和 "=d" 指示将结果分别返回给变量 a 和 d。
+  while (i + 32 <= n)
+    {
+      __m256i cnt = _mm256_setzero_si256();
+
+      //At most 4 bits per byte: 63 rounds fit the byte counters
+      for (u64 j = 0; j < 63 && i + 32 <= n; j++, i += 32)
+	{
+	  __m256i x = _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(a + i)),
+				       _mm256_loadu_si256((__m256i *)(b + i)));
+
+	  x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi64(x, 1)), m55);
+	  cnt = _mm256_add_epi8(cnt, popcnt8_avx2(x));
+	}
+
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
 
-  return ((d << 32) | a); //通过将 d 左移32位并与 a 进行位或操作，将获取的TSC值合并为一个64位的无符号整数，然后将其作为函数的返回值。
-} //这个函数允许程序在需要测量执行时间或性能时获取TSC计数值。由于TSC的计数单位是CPU时钟周期，因此可以使用它来进行精确的时间测量。
-  //TSC值在不同的CPU和系统上可能有不同的行为，因此在跨平台应用中需要小心处理。
+  return hsum_epu64(acc) + mismatch_packed_c(a + i, b + i, (n - i) * 4);
+}
 
 //
-void error()
+u64 mismatch_packed(u8 *a, u8 *b, u64 len)
 {
-  //打印错误消息，其中包括错误标识符 err_id 和与该错误标识符相关的错误消息 err_msg[err_id]。
-  //这将在标准输出中显示错误的描述，以帮助程序员或用户理解错误的类型和原因。
-  printf("Error (%llu): %s\n", err_id, err_msg[err_id]);
-  
-  //调用 exit 函数，终止程序的执行并返回退出状态 -1，表示程序因错误而非正常退出。
-  //这将终止程序的执行并返回一个错误状态，以通知调用者或操作系统发生了错误。
-  exit(-1);
-} //在错误处理中，当某个函数或操作遇到错误情况时，通常会调用类似 error 函数来报告和处理错误。
-  //这有助于提高程序的可维护性和可读性，因为错误处理的代码可以在一个地方进行集中管理，而不需要在多个地方分散处理错误。
-  //同时，使用错误消息和错误标识符也可以更好地记录和诊断程序中发生的错误。
+  if (__builtin_cpu_supports("avx2"))
+    return mismatch_packed_avx2(a, b, len);
 
-//
-seq_t *load_seq(const char *fname)
+  return mismatch_packed_c(a, b, len);
+}
+
+//Conversion and mismatch counts on text vs packed data
+int bench_packed(const char *f1, const char *f2)
 {
-  //首先检查传递给函数的文件名指针 fname 是否为 NULL。如果是 NULL，表示文件名未提供，
-  //因此将错误标识符 err_id 设置为 ERR_FNAME_NULL，并返回 NULL 指针，表示出现了错误。
-  if (!fname)
+  seq_t *s1 = load_seq(f1);
+
+  if (!s1)
+    error();
+
+  seq_t *s2 = load_seq(f2);
+
+  if (!s2)
+    error();
+
+  int text = memcmp(s1->bases, DNA2_MAGIC, 8) && memcmp(s2->bases, DNA2_MAGIC, 8);
+  u64 a = 0, b = 0;
+
+  b = rdtsc();
+  pseq_t *p1 = pack_seq(s1);
+  a = rdtsc();
+
+  if (!p1)
+    error();
+
+  pseq_t *p2 = pack_seq(s2);
+
+  if (!p2)
+    error();
+
+  if (p1->len != p2->len)
+    return printf("Error: sequences must match in length\n"), 2;
+
+  u64 len = p1->len;
+  u64 reps = (len < REPS) ? REPS / (len + 1) + 1 : 1;
+
+  printf("bases          : %llu (%llu bytes packed)\n", len, (len + 3) / 4);
+  
+  if (text)
     {
-      err_id = ERR_FNAME_NULL;
-      return NULL;
+      u8 *tmp = malloc((len + 3) / 4);
+
+      if (!tmp)
+	return printf("Error: cannot allocate memory\n"), 3;
+      
+      printf("pack           : cycles/base: %.3lf\n", (double)(a - b) / len);
+      
+      b = rdtsc();
+      
+      for (u64 i = 0; i < reps; i++)
+	pack_c(tmp, s1->bases, len);
+      
+      a = rdtsc();
+
+      printf("pack_c         : cycles/base: %.3lf\n", (double)(a - b) / reps / len);
+
+      if (__builtin_cpu_supports("avx2"))
+	{
+	  b = rdtsc();
+	  
+	  for (u64 i = 0; i < reps; i++)
+	    pack_avx2(tmp, s1->bases, len);
+	  
+	  a = rdtsc();
+
+	  printf("pack_avx2      : cycles/base: %.3lf %s\n", (double)(a - b) / reps / len,
+		 memcmp(tmp, p1->bits, (len + 3) / 4) ? "(MISMATCH)" : "");
+	}
+
+      free(tmp);
     }
 
-  //创建一个名为 sb 的结构体，用于存储文件状态信息，包括文件大小等。
-  struct stat sb;
+  //Calls go through a volatile pointer so the compiler cannot hoist them out of the loop
+  struct { const char *name; u64 (*f)(u8 *, u8 *, u64); int ok; u8 *x, *y; } kernels[] = {
+
+    { "mismatch_c     ", mismatch_c,           text, s1->bases, s2->bases },
+    { "packed_c       ", mismatch_packed_c,    1,    p1->bits,  p2->bits  },
+    { "packed_avx2    ", mismatch_packed_avx2, __builtin_cpu_supports("avx2"), p1->bits, p2->bits },
+    { NULL, NULL, 0, NULL, NULL }
+  };
 
-  //使用 stat 函数获取文件 fname 的状态信息，并将结果存储在 sb 结构体中。
-  //如果 stat 函数返回小于0的值（通常是-1），表示获取状态信息失败，可能是因为文件不存在或其他问题。
-  //在这种情况下，将错误标识符 err_id 设置为 ERR_STAT，并返回 NULL 指针，表示出现了错误。
-  if (stat(fname, &sb) < 0)
+  for (u64 k = 0; kernels[k].name; k++)
     {
-      err_id = ERR_STAT;
-      return NULL;
+      u64 (*volatile f)(u8 *, u8 *, u64) = kernels[k].f;
+      u64 m = 0;
+
+      if (!kernels[k].ok)
+	continue;
+      
+      b = rdtsc();
+
+      for (u64 i = 0; i < reps; i++)
+	m = f(kernels[k].x, kernels[k].y, len);
+
+      a = rdtsc();
+
+      printf("%s: %llu mismatches, cycles/base: %.3lf\n", kernels[k].name, m, (double)(a - b) / reps / len);
     }
   
-  //Allocate sequence 
-  //在这里，为存储序列数据的 seq_t 结构体分配内存，并将指针存储在 s 中。
-  //如果内存分配失败，将错误标识符 err_id 设置为 ERR_MALLOC_NULL，并返回 NULL 指针，表示出现了错误。
-  seq_t *s = malloc(sizeof(seq_t));
+  release_pseq(p1); free(p1);
+  release_pseq(p2); free(p2);
+  release_seq(s1); free(s1);
+  release_seq(s2); free(s2);
+
+  return 0;
+}
+
+//Streaming Hamming distance for files that do not fit in memory: a reader
+//thread fills one pair of buffers while the kernel runs on the other one,
+//so memory use is 4 chunks whatever the file size.
+#define STREAM_CHUNK (4ULL << 20)
+
+//
+typedef struct {
+
+  //Input files
+  int fd[2];
+
+  //Chunk size in bytes
+  u64 chunk;
+
+  //Double buffer: buf[slot][file], n[slot] valid bytes, full[slot] ready for the kernel
+  u8 *buf[2][2];
+  u64 n[2];
+  int full[2];
+
+  //Set by the reader at end of input, err when the files differ in length
+  int done, err;
+
+  //
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
   
-  if (!s)
+} stream_t;
+
+//Reads up to n bytes, retrying short reads
+static u64 read_full(int fd, u8 *p, u64 n)
+{
+  u64 r = 0;
+
+  while (r < n)
     {
-      err_id = ERR_MALLOC_NULL;
-      return NULL;
+      ssize_t k = read(fd, p + r, n - r);
+
+      if (k <= 0)
+	break;
+
+      r += k;
     }
   
-  //Length of sequence is file size in bytes
-  //将结构体 seq_t 中的 s->len 成员设置为 sb.st_size，其中 sb.st_size 是一个表示文件大小的变量，通常是通过文件状态信息（stat）获得的。
-  //这行代码将文件的大小分配给序列结构体中的 len 成员，以表示序列的长度。
-  s->len = sb.st_size; 
+  return r;
+}
 
-  //Allocating memory for sequence bases
-  //为存储序列元素或字节数据的数组 s->bases 分配内存。分配的内存大小是 sb.st_size 乘以 sizeof(u8)，即文件大小乘以一个字节的大小。
-  //这将创建一个能够容纳整个序列的内存块，并将指向该内存块的指针存储在 s->bases 成员中。
-  s->bases = malloc(sizeof(u8) * sb.st_size);
-  
-  if (!s->bases) //在动态内存分配失败时执行以下操作。
+//Prefetch thread
+static void *_stream_reader_(void *arg)
+{
+  stream_t *st = arg;
+
+  for (u64 slot = 0; ; slot ^= 1)
     {
-      err_id = ERR_MALLOC_NULL;  //将错误标识符 err_id 设置为 ERR_MALLOC_NULL，表示内存分配失败的错误类型。
-      return NULL;  //返回 NULL 指针，表示内存分配失败，可能需要进行错误处理。
-    } //这段代码的主要目的是为表示序列数据的结构体 seq_t 分配内存，并将文件大小分配给序列的长度 len，
-      //以便可以在这个内存块中存储序列的元素。如果内存分配失败，它会设置错误标识符，并返回 NULL 指针以指示错误状态。
-      //这是在处理从文件读取的序列数据时执行的初始化操作。
-
-  //Opening the file
-  //使用 fopen 函数以只读二进制模式打开指定文件 fname。
-  //如果打开文件失败（fp 为 NULL），则将错误标识符 err_id 设置为 ERR_OPEN_FILE，表示无法打开文件，然后返回 NULL 指针，表示出现了错误。
-  FILE *fp = fopen(fname, "rb");
-
-  if (!fp)
+      pthread_mutex_lock(&st->lock);
+
+      while (st->full[slot])
+	pthread_cond_wait(&st->cond, &st->lock);
+
+      pthread_mutex_unlock(&st->lock);
+
+      u64 na = read_full(st->fd[0], st->buf[slot][0], st->chunk);
+      u64 nb = read_full(st->fd[1], st->buf[slot][1], st->chunk);
+      
+      pthread_mutex_lock(&st->lock);
+      
+      if (na != nb)
+	st->err = 1;
+
+      if (na && na == nb)
+	{
+	  st->n[slot] = na;
+	  st->full[slot] = 1;
+	}
+      
+      if (na < st->chunk || na != nb)
+	st->done = 1;
+
+      pthread_cond_broadcast(&st->cond);
+      pthread_mutex_unlock(&st->lock);
+
+      if (st->done)
+	break;
+    }
+  
+  return NULL;
+}
+
+//Hamming distance of two files read in chunks, stall gets the time the
+//kernel spent waiting for data. Returns -1 on error.
+u64 hamming_stream(const char *f1, const char *f2, u64 chunk, double *stall)
+{
+  stream_t st = { .chunk = chunk };
+  pthread_t tid;
+  u64 h = 0;
+
+  st.fd[0] = open(f1, O_RDONLY);
+  st.fd[1] = open(f2, O_RDONLY);
+
+  if (st.fd[0] < 0 || st.fd[1] < 0)
     {
+      if (st.fd[0] >= 0) close(st.fd[0]);
+      if (st.fd[1] >= 0) close(st.fd[1]);
+      
       err_id = ERR_OPEN_FILE;
-      return NULL;
+      return -1;
     }
 
-  //Reading bytes from file
-  //使用 fread 函数从已经打开的文件中读取数据，读取的数据存储在 s->bases 中。s->len 表示要读取的元素数量，sizeof(u8) 表示每个元素的大小。
-  //read_bytes 存储了实际读取的字节数。如果读取失败，read_bytes 的值可能小于 s->len。
-  size_t read_bytes = fread(s->bases, sizeof(u8), s->len, fp);
+  posix_fadvise(st.fd[0], 0, 0, POSIX_FADV_SEQUENTIAL);
+  posix_fadvise(st.fd[1], 0, 0, POSIX_FADV_SEQUENTIAL);
+  
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 2; j++)
+      if (!(st.buf[i][j] = aligned_alloc(64, chunk)))
+	{
+	  //Buffers not allocated yet are still NULL (st is zero initialized)
+	  for (int k = 0; k < 4; k++)
+	    free(st.buf[k >> 1][k & 1]);
+
+	  close(st.fd[0]);
+	  close(st.fd[1]);
+
+	  err_id = ERR_MALLOC_NULL;
+	  return -1;
+	}
+  
+  pthread_mutex_init(&st.lock, NULL);
+  pthread_cond_init(&st.cond, NULL);
+  pthread_create(&tid, NULL, _stream_reader_, &st);
+
+  *stall = 0.0;
+  
+  for (u64 slot = 0; ; slot ^= 1)
+    {
+      double b = now();
+      
+      pthread_mutex_lock(&st.lock);
+
+      while (!st.full[slot] && !st.done)
+	pthread_cond_wait(&st.cond, &st.lock);
+
+      int ready = st.full[slot];
+      
+      pthread_mutex_unlock(&st.lock);
+
+      *stall += now() - b;
+      
+      if (!ready)
+	break;
+
+      h += hamming(st.buf[slot][0], st.buf[slot][1], st.n[slot]);
 
-  //Closing file
-  //使用 fclose 函数关闭已经打开的文件，释放文件资源。
-  fclose(fp);
+      pthread_mutex_lock(&st.lock);
+      st.full[slot] = 0;
+      pthread_cond_broadcast(&st.cond);
+      pthread_mutex_unlock(&st.lock);
+    }
+  
+  pthread_join(tid, NULL);
+  pthread_mutex_destroy(&st.lock);
+  pthread_cond_destroy(&st.cond);
 
-  //Check if bytes were fully read
-  //检查是否读取的字节数等于 s->len，如果不相等，将错误标识符 err_id 设置为 ERR_READ_BYTES，表示读取的字节数与序列的长度不匹配，
-  //然后返回 NULL 指针，表示出现了错误。
-  if (read_bytes != s->len)
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 2; j++)
+      free(st.buf[i][j]);
+  
+  close(st.fd[0]);
+  close(st.fd[1]);
+  
+  if (st.err)
     {
       err_id = ERR_READ_BYTES;
-      return NULL;
+      return -1;
     }
   
-  //如果一切正常，s 将包含加载的序列数据。
-  return s;
+  return h;
 }
 
-//释放 seq_t 结构体及其关联的内存
-void release_seq(seq_t *s)
+//Edit distance reference: dynamic programming on two rows
+u64 edit_dp(u8 *a, u64 m, u8 *b, u64 n)
 {
-  //检查传递给函数的 seq_t 结构体指针 s 是否为非空
-  //确保不会对空指针执行释放操作
-  if (s)
+  u64 *row = malloc((m + 1) * sizeof(u64));
+
+  if (!row)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+  
+  for (u64 i = 0; i <= m; i++)
+    row[i] = i;
+
+  for (u64 j = 1; j <= n; j++)
     {
-      //如果 seq_t 结构体中的 s->bases 成员（存储序列数据的指针）非空，则执行以下操作：
-      if (s->bases)  
-	free(s->bases);  //释放 s->bases 指向的内存块，这是为存储序列数据而分配的内存。
-      else
-	err_id = ERR_NULL_POINTER;  //将错误标识符 err_id 设置为 ERR_NULL_POINTER，表示尝试释放一个空指针。
-	  
-      //将 s->len 设置为0，表示序列长度为0
-      s->len = 0;
+      u64 diag = row[0];
+
+      row[0] = j;
+      
+      for (u64 i = 1; i <= m; i++)
+	{
+	  u64 up = row[i];
+	  u64 d = diag + (a[i - 1] != b[j - 1]);
+
+	  if (up + 1 < d)
+	    d = up + 1;
+
+	  if (row[i - 1] + 1 < d)
+	    d = row[i - 1] + 1;
+
+	  row[i] = d;
+	  diag = up;
+	}
     }
-  else
-    err_id = ERR_NULL_POINTER; //如果 seq_t 结构体指针 s 为空，则将错误标识符 err_id 设置为 ERR_NULL_POINTER，表示尝试释放一个空指针。
-} //这个函数用于在释放 seq_t 结构体及其关联的内存时进行安全的操作。
-  //它会检查指针的有效性，释放内存并清除相关数据，同时记录任何可能的错误情况。
-  //这有助于避免释放无效的内存或空指针，并提高程序的稳定性。
 
-//接受两个字节数组指针 a 和 b，以及一个无符号64位整数 n，表示要比较的字节数目。函数返回一个无符号64位整数，表示汉明距离。
-u64 hamming_c(u8 *a, u8 *b, u64 n)
+  u64 d = row[m];
+
+  free(row);
+  
+  return d;
+}
+
+//One 64 row block of Myers' algorithm (Hyyro's formulation): Pv/Mv are the
+//+1/-1 vertical deltas of the column, eq the rows matching the text base,
+//hin the horizontal delta entering above the block. Returns the horizontal
+//delta leaving at the row selected by high.
+static inline int myers_block(u64 *pv, u64 *mv, u64 eq, int hin, u64 high)
 {
-  //声明并初始化一个无符号64位整数 h 为0，用于存储汉明距离的计数。
-  u64 h = 0;
+  u64 xv = eq | *mv;
 
-  //使用 for 循环遍历 a 和 b 数组中的每个字节，i 从0递增到 n-1。
-  //在循环中，对每对相同位置上的字节执行以下操作：
-  for (u64 i = 0; i < n; i++)
-    h += __builtin_popcount(a[i] ^ b[i]); 
-  //a[i] ^ b[i] 计算 a 和 b 在相同位置上的字节的异或结果，这将标识出不同字节的位。
-  //__builtin_popcount 是一个内置函数，它用于计算整数中设置为1的位的数量，这里用于计算不同字节的位数。
-  //将结果添加到 h 中，以累积汉明距离
+  if (hin < 0)
+    eq |= 1;
 
-  //返回计算得到的汉明距离，即两个字节数组之间的不同字节的位数之和。
-  return h;
-} //这个函数使用循环遍历两个数组中的每个字节，计算它们之间的不同位数，最终返回汉明距离。
-  //这是一种常用的方法来衡量两个二进制序列之间的差异。
+  u64 xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+  u64 ph = *mv | ~(xh | *pv);
+  u64 mh = *pv & xh;
+  int hout = (ph & high) ? 1 : (mh & high) ? -1 : 0;
+
+  ph <<= 1;
+  mh <<= 1;
+
+  if (hin < 0)
+    mh |= 1;
+  else
+    if (hin > 0)
+      ph |= 1;
 
-//这段代码实现了一个名为 hamming_asm_8bits 的汉明距离计算函数，使用汇编语言来执行
-//这是函数的声明，接受两个字节数组指针 a 和 b，以及一个无符号64位整数 n，表示要比较的字节数目。
-//函数返回一个无符号64位整数，表示汉明距离。
-u64 hamming_asm_8bits(u8 *a, u8 *b, u64 n)
+  *pv = mh | ~(xv | ph);
+  *mv = ph & xv;
+
+  return hout;
+}
+
+//Banded Myers: at text position j only the blocks holding rows j - k .. j + k
+//are updated (Ukkonen's band), the rows above keep their last state and the
+//new blocks below start from vertical +1 deltas. Cells outside the band are
+//only over-estimated, so the result is exact when it is <= k.
+//Returns the distance, or -1 when it exceeds k.
+u64 edit_myers_banded(u8 *a, u64 m, u8 *b, u64 n, u64 k)
 {
-  //在函数开始时，声明并初始化一个无符号64位整数 h 为0，用于存储汉明距离的计数。
-  u64 h = 0;
+  if ((m > n ? m - n : n - m) > k)
+    return -1;
 
-  //Size in bytes
-  //将 sizeb 初始化为 n，表示要比较的字节数目。
-  u64 sizeb = n;
-  
-  //汇编代码块：在这个块中，使用汇编语言来执行汉明距离的计算。这个块包括一系列汇编指令，用于循环遍历字节数组 a 和 b 并计算汉明距离。
-  __asm__ volatile (
-        //xor 指令用于清零寄存器
-		    "xor %%rax, %%rax;\n"  
-		    "xor %%rbx, %%rbx;\n"
-		    "xor %%rcx, %%rcx;\n"
-		    "xor %%rdx, %%rdx;\n"
-
-        //1:; 是一个标签，用于表示循环的入口点
-		    "1:;\n" 
-
-		    //Loading bytes   
-        //movb 指令用于加载字节值     
-		    "movb (%[_a], %%rcx), %%al;\n" 
-		    "movb (%[_b], %%rcx), %%bl;\n"
-
-		    //Xoring bytes    
-        //xor 指令用于执行异或操作
-		    "xor %%bl, %%al;\n"
-
-		    //Popcount on 16bits (no 8 bits popcount on x86)     
-        //popcnt 指令用于计算汉明距离的16位部分
-		    "popcnt %%ax, %%bx;\n"
-		    
-        //add 指令用于累积汉明距离
-		    "add %%rbx, %%rdx;\n"  
-		    
-        //add 指令用于递增循环计数器
-		    "add $1, %%rcx;\n"   
-        //add 指令用于递增循环计数器  
-		    "cmp %[_sizeb], %%rcx;\n"   
-        //jl 指令用于条件跳转，如果计数器小于 sizeb，则继续循环
-		    "jl 1b;\n"          
-		    
-        //将计算得到的汉明距离存储在寄存器 rdx 中的值传递给输出变量 h
-		    "mov %%rdx, %[_h];\n"    
-		    
-		    : //outputs 
-		      [_h] "=r" (h)
-		      
-		    : //inputs
-		      [_a]     "r" (a),
-		      [_b]     "r" (b),
-		      [_sizeb] "r" (sizeb)
-		      
-		    :
-		    "cc", "memory", "rax", "rbx", "rcx", "rdx");
-  
-  //返回计算得到的汉明距离 h
-  return h;
-} //这个函数使用汇编语言来执行汉明距离的计算，通过循环遍历字节数组 a 和 b 中的每个字节，执行异或和汉明距离计算操作，
-  //最终返回汉明距离。这种方法可以在汇编级别更有效地执行计算。
+  if (!m)
+    return n;
+
+  if (!n)
+    return m;
+
+  u64 w = (m + 63) / 64;
+  u64 *pv = malloc(w * sizeof(u64));
+  u64 *mv = malloc(w * sizeof(u64));
+  u8 idx[256] = { 0 };
+  u64 sigma = 0;
+
+  //Only the symbols of a get a row in the match table, index 0 matches nothing
+  for (u64 i = 0; i < m; i++)
+    if (!idx[a[i]])
+      idx[a[i]] = ++sigma;
+
+  u64 *peq = calloc((sigma + 1) * w, sizeof(u64));
+
+  if (!pv || !mv || !peq)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+  
+  for (u64 i = 0; i < m; i++)
+    peq[(idx[a[i]] * w) + (i >> 6)] |= 1ULL << (i & 63);
+
+  //Last computed block, and the score of its bottom row (rows are 1-based,
+  //block x holds rows 64x + 1 .. 64x + 64)
+  long long hi = -1;
+  u64 bottom = 0, score = 0;
+  
+  for (u64 j = 1; j <= n; j++)
+    {
+      u64 lo = (j > k + 1) ? (j - k - 1) / 64 : 0;
+      long long top = (j + k - 1) / 64;
+
+      if (top > (long long)w - 1)
+	top = w - 1;
+
+      //New blocks: the rows below the band are reached by vertical steps only
+      while (hi < top)
+	{
+	  hi++;
+	  pv[hi] = ~0ULL;
+	  mv[hi] = 0;
+
+	  u64 r = ((u64)(hi + 1) * 64 < m) ? (hi + 1) * 64 : m;
+	  
+	  score += r - bottom;
+	  bottom = r;
+	}
 
-//这个版本处理64位块而不是字节，从而提高了效率
-u64 hamming_asm_64bits(u8 *a, u8 *b, u64 n)
+      if (lo > (u64)hi)
+	break;
+      
+      u64 *eq = peq + (idx[b[j - 1]] * w);
+      int h = 1;
+
+      for (u64 x = lo; x < (u64)hi; x++)
+	h = myers_block(pv + x, mv + x, eq[x], h, 1ULL << 63);
+
+      score += myers_block(pv + hi, mv + hi, eq[hi], h, 1ULL << ((bottom - 1) & 63));
+    }
+
+  free(pv);
+  free(mv);
+  free(peq);
+
+  //The last row has to be inside the band at the end of the text
+  if (bottom != m || score > k)
+    return -1;
+  
+  return score;
+}
+
+//Full Myers: a band wider than both sequences
+u64 edit_myers(u8 *a, u64 m, u8 *b, u64 n)
 {
-  //
-  u64 h = 0;
+  return edit_myers_banded(a, m, b, n, (m > n) ? m : n);
+}
+
+//Edit distance of two sequences of any length
+int bench_edit(const char *f1, const char *f2, u64 k)
+{
+  seq_t *s1 = load_seq_mmap(f1, 0);
+
+  if (!s1)
+    error();
+
+  seq_t *s2 = load_seq_mmap(f2, 0);
 
-  //Size in bytes
-  u64 sizeb = n;
+  if (!s2)
+    error();
+
+  u64 m = s1->len, n = s2->len;
+
+  //Trailing newlines are not part of the sequences
+  while (m && (s1->bases[m - 1] == '\n' || s1->bases[m - 1] == '\r'))
+    m--;
+
+  while (n && (s2->bases[n - 1] == '\n' || s2->bases[n - 1] == '\r'))
+    n--;
+
+  double cells = (double)m * n, b, a;
+  u64 ref = -1, d;
+
+  //Quadratic reference only on small inputs
+  if (cells <= 1e9)
+    {
+      b = now(); ref = edit_dp(s1->bases, m, s2->bases, n); a = now();
+      
+      printf("edit_dp        : %llu, %.3lf s, %.3lf Gcells/s\n", ref, a - b, cells / (a - b) / 1e9);
+    }
   
-  //
-  __asm__ volatile (
-		    "xor %%rcx, %%rcx;\n"
-		    "xor %%rdx, %%rdx;\n"
-
-		    "1:;\n"
-
-		    //Loading 64bit blocks rather than bytes
-        //movq 指令用于加载64位块的值
-		    "movq (%[_a], %%rcx), %%rax;\n" 
-		    "movq (%[_b], %%rcx), %%rbx;\n"
-
-		    //
-		    "xor %%rbx, %%rax;\n"
-		    "popcnt %%rax, %%rbx;\n"
-
-		    "add %%rbx, %%rdx;\n"
-		    
-		    "add $8, %%rcx;\n"
-		    "cmp %[_sizeb], %%rcx;\n"
-		    "jl 1b;\n"
-
-		    "mov %%rdx, %[_h];\n"
-		    
-		    : //outputs
-		      [_h] "=r" (h)
-		      
-		    : //inputs
-		      [_a]     "r" (a),
-		      [_b]     "r" (b),
-		      [_sizeb] "r" (sizeb)
-		      
-		    :
-		    "cc", "memory", "rax", "rbx", "rcx", "rdx");
+  b = now(); d = edit_myers(s1->bases, m, s2->bases, n); a = now();
+
+  printf("edit_myers     : %llu, %.3lf s, %.3lf Gcells/s %s\n", d, a - b, cells / (a - b) / 1e9,
+	 (ref != (u64)-1 && d != ref) ? "(MISMATCH)" : "");
+
+  if (ref == (u64)-1)
+    ref = d;
   
-  //
-  return h;
-} //这个版本的函数相比前一个版本处理的数据块更大，因此在处理大量数据时可能会更快。
-  //它的原理与前一个版本类似，只是每次处理64位块而不是单个字节。这种方法可以在汇编级别更有效地执行计算。
+  if (k != (u64)-1)
+    {
+      b = now(); d = edit_myers_banded(s1->bases, m, s2->bases, n, k); a = now();
+
+      if (d == (u64)-1)
+	printf("edit_banded    : > %llu, %.3lf s %s\n", k, a - b, (ref <= k) ? "(MISMATCH)" : "");
+      else
+	printf("edit_banded    : %llu, %.3lf s %s\n", d, a - b, (d != ref) ? "(MISMATCH)" : "");
+    }
+  
+  release_seq(s1); free(s1);
+  release_seq(s2); free(s2);
+
+  return 0;
+}
+
+//Startup time, first full pass and resident memory of both loaders
+int bench_load(const char *fname, int huge)
+{
+  struct { const char *name; int mmap; } loaders[] = { { "fread", 0 }, { "mmap ", 1 } };
+  
+  hamming_init();
+  
+  for (int l = 0; l < 2; l++)
+    {
+      u64 r0 = rss();
+      double b = now();
+      seq_t *s = loaders[l].mmap ? load_seq_mmap(fname, huge) : load_seq(fname);
+      double a = now();
+      
+      if (!s)
+	error();
+
+      //First pass touches every page
+      double t = now();
+      u64 h = hamming(s->bases, s->bases + s->len / 2, s->len / 2);
+      double e = now();
+      
+      printf("%s: %llu bytes, load: %.6lf s, first pass: %.6lf s, rss: +%.1lf MB (%llu)\n",
+	     loaders[l].name, s->len, a - b, e - t, (double)(rss() - r0) / (1 << 20), h);
+      
+      release_seq(s); free(s);
+    }
+
+  return 0;
+}
 
 //比较不同方法计算两个序列之间的汉明距离
 int main(int argc, char **argv)
 {
   //检查命令行参数是否足够，需要提供两个序列文件
   if (argc < 3)
-    return printf("Usage: %s [seq1] [seq2]\n", argv[0]), 1;
+    return printf("Usage: %s [seq1] [seq2]\n"
+		  "       %s packed [seq1] [seq2]\n"
+		  "       %s load [seq] [huge]\n"
+		  "       %s stream [seq1] [seq2] [chunk MB]\n"
+		  "       %s edit [seq1] [seq2] [max distance]\n", argv[0], argv[0], argv[0], argv[0], argv[0]), 1;
+
+  //Levenshtein distance, lengths may differ
+  if (!strcmp(argv[1], "edit"))
+    {
+      if (argc < 4)
+	return printf("Error: edit needs two sequences\n"), 1;
+
+      return bench_edit(argv[2], argv[3], (argc > 4) ? atoll(argv[4]) : -1);
+    }
+
+  //Chunked Hamming with constant memory
+  if (!strcmp(argv[1], "stream"))
+    {
+      if (argc < 4)
+	return printf("Error: stream needs two sequences\n"), 1;
+
+      u64 chunk = (argc > 4) ? atoll(argv[4]) << 20 : STREAM_CHUNK;
+      double stall = 0.0;
+      
+      if (!chunk)
+	return printf("Error: chunk size must be > 0\n"), 2;
+
+      hamming_init();
+
+      double b = now();
+      u64 h = hamming_stream(argv[2], argv[3], chunk, &stall);
+      double a = now();
+
+      if (h == (u64)-1)
+	error();
+
+      struct stat sb;
+
+      stat(argv[2], &sb);
+      
+      printf("hamming_stream : %llu, %.3lf s, %.3lf GB/s, kernel stalled %.3lf s, buffers: %llu MB\n",
+	     h, a - b, 2.0 * sb.st_size / (a - b) / 1e9, stall, (4 * chunk) >> 20);
+
+      return 0;
+    }
+
+  //fread vs mmap loading
+  if (!strcmp(argv[1], "load"))
+    return bench_load(argv[2], (argc > 3) ? atoi(argv[3]) : 0);
+
+  //Packed 2-bit format
+  if (!strcmp(argv[1], "packed"))
+    {
+      if (argc < 4)
+	return printf("Error: packed needs two sequences\n"), 1;
+      
+      return bench_packed(argv[2], argv[3]);
+    }
   
   //Loading first sequence
   //加载第一个序列，使用 load_seq 函数从文件中读取序列数据
@@ -339,52 +821,48 @@ int main(int argc, char **argv)
   //Check size
   //检查两个序列的长度是否相等，因为汉明距离需要两个等长的序列
   if (s1->len != s2->len)
-    return printf("Error: sequences must match in length"), 2;
-  
-  //存储不同方法计算得到的汉明距离
-  u64 h_c     = 0; 
-  u64 h_asm8  = 0; 
-  u64 h_asm64 = 0; 
-
-  //定义了变量 a 和 b 来存储时间戳，以及 e_c、e_asm8 和 e_asm64 来存储执行计算的时间。
-  u64 a = 0, b = 0;
-  u64 e_c = 0, e_asm8 = 0, e_asm64 = 0;
+    return printf("Error: sequences must match in length (see '%s edit')\n", argv[0]), 2;
   
-  //C
-  //使用 rdtsc 函数获取时间戳
-  b = rdtsc();
+  hamming_init();
   
-  //使用循环 for (u64 i = 0; i < REPS; i++) 来重复计算汉明距离，其中 REPS 表示重复次数。
-  //计算不同方法的执行时间差并存储在 e_c、e_asm8 和 e_asm64 中
-  for (u64 i = 0; i < REPS; i++)
-    h_c     = hamming_c(s1->bases, s2->bases, s1->len);
-
-  a = rdtsc();
-  e_c = a - b;
-
-  //ASM 8 bits
-  b = rdtsc();
-  
-  for (u64 i = 0; i < REPS; i++)
-    h_asm8 = hamming_asm_8bits(s1->bases, s2->bases, s1->len);
-
-  a = rdtsc();
-  e_asm8 = a - b;
+  //Repetitions are scaled down for long sequences
+  u64 reps = (s1->len < REPS) ? REPS / (s1->len + 1) + 1 : 1;
 
+  //
+  struct { const char *name; u64 (*f)(u8 *, u8 *, u64); int ok; } kernels[] = {
+
+    { "hamming_c      ", hamming_c,          1 },
+    { "hamming_asm8   ", hamming_asm_8bits,  1 },
+    { "hamming_asm64  ", hamming_asm_64bits, 1 },
+    { "hamming_lut    ", hamming_avx2_lut,   __builtin_cpu_supports("avx2") },
+    { "hamming_hs     ", hamming_avx2_hs,    __builtin_cpu_supports("avx2") },
+    { "hamming_avx512 ", hamming_avx512,     __builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512bw") },
+    { "hamming        ", hamming,            1 },
+    { NULL, NULL, 0 }
+  };
   
-  //ASM 8 bits
-  b = rdtsc();
-  
-  for (u64 i = 0; i < REPS; i++)
-    h_asm64 = hamming_asm_64bits(s1->bases, s2->bases, s1->len);
-
-  a = rdtsc();
-  e_asm64 = a - b;
-  
-  //打印每种方法计算的汉明距离和平均循环次数。
-  printf("hamming_c    : %llu, cycles: %llu\n", h_c    , e_c     / REPS);
-  printf("hamming_asm8 : %llu, cycles: %llu\n", h_asm8 , e_asm8  / REPS);
-  printf("hamming_asm64: %llu, cycles: %llu\n", h_asm64, e_asm64 / REPS);
+  //Calls go through a volatile pointer so the compiler cannot hoist them out of the loop
+  for (u64 k = 0; kernels[k].name; k++)
+    {
+      u64 (*volatile f)(u8 *, u8 *, u64) = kernels[k].f;
+      u64 h = 0, a = 0, b = 0;
+
+      if (!kernels[k].ok)
+	{
+	  printf("%s: not supported\n", kernels[k].name);
+	  continue;
+	}
+      
+      b = rdtsc();
+      
+      for (u64 i = 0; i < reps; i++)
+	h = f(s1->bases, s2->bases, s1->len);
+      
+      a = rdtsc();
+      
+      printf("%s: %llu, cycles: %llu, cycles/byte: %.3lf\n", kernels[k].name, h,
+	     (a - b) / reps, (double)(a - b) / reps / s1->len);
+    }
   
   //释放内存并释放序列数据。
   release_seq(s1); free(s1);
@@ -0,0 +1,363 @@
+//Batch image pipeline: load -> filter -> write over a directory of PPM images
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "ppm.h"
+#include "filter.h"
+
+//
+typedef struct {
+
+  //Input and output paths
+  char *in, *out;
+
+  //Image, NULL until loaded
+  ppm_t *p;
+
+} job_t;
+
+//Bounded FIFO between two stages: producers block when it is full,
+//consumers block when it is empty and get NULL once it is closed and drained
+typedef struct {
+
+  job_t **items;
+  u64 cap, head, count;
+  int closed;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_full, not_empty;
+
+} queue_t;
+
+//Stage threads share the queues and the statistics
+typedef struct {
+
+  job_t *jobs;
+  u64 njobs;
+
+  queue_t *loaded, *filtered;
+
+  //Workers still running, the last one closes the filtered queue
+  u64 workers;
+
+  //Time spent working (not waiting) per stage
+  double t_load, t_filter, t_write;
+
+  //Images and pixel bytes written
+  u64 images, bytes;
+
+  pthread_mutex_t lock;
+
+} pipeline_t;
+
+//
+void queue_init(queue_t *q, u64 cap)
+{
+  q->items = malloc(cap * sizeof(job_t *));
+
+  if (!q->items)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  q->cap = cap;
+  q->head = q->count = 0;
+  q->closed = 0;
+
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+}
+
+//
+void queue_release(queue_t *q)
+{
+  free(q->items);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->not_full);
+  pthread_cond_destroy(&q->not_empty);
+}
+
+//
+void queue_push(queue_t *q, job_t *j)
+{
+  pthread_mutex_lock(&q->lock);
+
+  while (q->count == q->cap)
+    pthread_cond_wait(&q->not_full, &q->lock);
+
+  q->items[(q->head + q->count++) % q->cap] = j;
+
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+//
+job_t *queue_pop(queue_t *q)
+{
+  job_t *j = NULL;
+
+  pthread_mutex_lock(&q->lock);
+
+  while (!q->count && !q->closed)
+    pthread_cond_wait(&q->not_empty, &q->lock);
+
+  if (q->count)
+    {
+      j = q->items[q->head];
+      q->head = (q->head + 1) % q->cap;
+      q->count--;
+
+      pthread_cond_signal(&q->not_full);
+    }
+
+  pthread_mutex_unlock(&q->lock);
+
+  return j;
+}
+
+//No more pushes, wakes up every consumer
+void queue_close(queue_t *q)
+{
+  pthread_mutex_lock(&q->lock);
+
+  q->closed = 1;
+
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+//Stage 1: disk -> memory, blocks while the queue is full
+void *_loader_(void *arg)
+{
+  pipeline_t *pl = arg;
+
+  for (u64 i = 0; i < pl->njobs; i++)
+    {
+      double b = now();
+
+      pl->jobs[i].p = read_ppm(pl->jobs[i].in);
+      pl->t_load += now() - b;
+
+      if (pl->jobs[i].p)
+	queue_push(pl->loaded, &pl->jobs[i]);
+    }
+
+  queue_close(pl->loaded);
+
+  return NULL;
+}
+
+//Stage 2: worker pool, filters in place
+void *_worker_(void *arg)
+{
+  pipeline_t *pl = arg;
+  double busy = 0.0;
+  job_t *j;
+
+  while ((j = queue_pop(pl->loaded)))
+    {
+      double b = now();
+
+      ppm_apply(j->p, invert);
+      busy += now() - b;
+
+      queue_push(pl->filtered, j);
+    }
+
+  pthread_mutex_lock(&pl->lock);
+
+  pl->t_filter += busy;
+
+  if (!--pl->workers)
+    queue_close(pl->filtered);
+
+  pthread_mutex_unlock(&pl->lock);
+
+  return NULL;
+}
+
+//Stage 3: memory -> disk
+void *_writer_(void *arg)
+{
+  pipeline_t *pl = arg;
+  job_t *j;
+
+  while ((j = queue_pop(pl->filtered)))
+    {
+      double b = now();
+
+      write_ppm_pwrite(j->p, j->out);
+
+      pl->images++;
+      pl->bytes += j->p->w * j->p->h * 3;
+
+      release_ppm(j->p); free(j->p);
+      j->p = NULL;
+
+      pl->t_write += now() - b;
+    }
+
+  return NULL;
+}
+
+//Loader, nw workers and a writer connected by queues of depth entries
+void run_pipeline(pipeline_t *pl, u64 nw, u64 depth)
+{
+  queue_t loaded, filtered;
+  pthread_t loader, writer, *workers = malloc(nw * sizeof(pthread_t));
+
+  if (!workers)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  queue_init(&loaded, depth);
+  queue_init(&filtered, depth);
+
+  pl->loaded = &loaded;
+  pl->filtered = &filtered;
+  pl->workers = nw;
+  pl->t_load = pl->t_filter = pl->t_write = 0.0;
+  pl->images = pl->bytes = 0;
+
+  pthread_mutex_init(&pl->lock, NULL);
+
+  pthread_create(&loader, NULL, _loader_, pl);
+  pthread_create(&writer, NULL, _writer_, pl);
+
+  for (u64 i = 0; i < nw; i++)
+    pthread_create(&workers[i], NULL, _worker_, pl);
+
+  pthread_join(loader, NULL);
+
+  for (u64 i = 0; i < nw; i++)
+    pthread_join(workers[i], NULL);
+
+  pthread_join(writer, NULL);
+
+  pthread_mutex_destroy(&pl->lock);
+  queue_release(&loaded);
+  queue_release(&filtered);
+  free(workers);
+}
+
+//Baseline: one image at a time, like running 6 once per file
+void run_sequential(pipeline_t *pl)
+{
+  pl->images = pl->bytes = 0;
+
+  for (u64 i = 0; i < pl->njobs; i++)
+    {
+      ppm_t *p = read_ppm(pl->jobs[i].in);
+
+      if (!p)
+	continue;
+
+      ppm_apply(p, invert);
+      write_ppm_pwrite(p, pl->jobs[i].out);
+
+      pl->images++;
+      pl->bytes += p->w * p->h * 3;
+
+      release_ppm(p); free(p);
+    }
+}
+
+//
+static int cmp_jobs(const void *a, const void *b)
+{
+  return strcmp(((job_t *)a)->in, ((job_t *)b)->in);
+}
+
+//One job per .ppm file of the input directory
+job_t *list_jobs(const char *in, const char *out, u64 *njobs)
+{
+  DIR *dir = opendir(in);
+  job_t *jobs = NULL;
+  u64 n = 0, cap = 0;
+  struct dirent *e;
+
+  if (!dir)
+    return printf("Error: cannot open directory '%s'\n", in), NULL;
+
+  while ((e = readdir(dir)))
+    {
+      u64 len = strlen(e->d_name);
+
+      if (len < 5 || strcmp(e->d_name + len - 4, ".ppm"))
+	continue;
+
+      if (n == cap)
+	{
+	  cap = cap ? 2 * cap : 64;
+	  jobs = realloc(jobs, cap * sizeof(job_t));
+
+	  if (!jobs)
+	    return printf("Error: cannot allocate memory\n"), NULL;
+	}
+
+      jobs[n].in = malloc(strlen(in) + len + 2);
+      jobs[n].out = malloc(strlen(out) + len + 2);
+      jobs[n].p = NULL;
+
+      sprintf(jobs[n].in, "%s/%s", in, e->d_name);
+      sprintf(jobs[n].out, "%s/%s", out, e->d_name);
+
+      n++;
+    }
+
+  closedir(dir);
+
+  qsort(jobs, n, sizeof(job_t), cmp_jobs);
+
+  *njobs = n;
+
+  return jobs;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+    return printf("Usage: %s [input directory] [output directory] [workers] [queue depth]\n", argv[0]), 1;
+
+  u64 nw = (argc > 3) ? atoll(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+  u64 depth = (argc > 4) ? atoll(argv[4]) : 8;
+  pipeline_t pl = { 0 };
+
+  if (!nw || !depth)
+    return printf("Error: workers and queue depth must be > 0\n"), 2;
+
+  mkdir(argv[2], 0755);
+
+  pl.jobs = list_jobs(argv[1], argv[2], &pl.njobs);
+
+  if (!pl.njobs)
+    return printf("Error: no .ppm file in '%s'\n", argv[1]), 3;
+
+  double b = now();
+  run_sequential(&pl);
+  double a = now();
+
+  printf("sequential: %llu images, %.3lf s, %8.1lf images/s, %8.1lf MB/s\n",
+	 pl.images, a - b, pl.images / (a - b), pl.bytes / (a - b) / 1e6);
+
+  b = now();
+  run_pipeline(&pl, nw, depth);
+  a = now();
+
+  printf("pipeline  : %llu images, %.3lf s, %8.1lf images/s, %8.1lf MB/s (%llu workers, depth %llu)\n",
+	 pl.images, a - b, pl.images / (a - b), pl.bytes / (a - b) / 1e6, nw, depth);
+
+  printf("busy      : load %.3lf s, filter %.3lf s, write %.3lf s\n", pl.t_load, pl.t_filter, pl.t_write);
+
+  for (u64 i = 0; i < pl.njobs; i++)
+    {
+      free(pl.jobs[i].in);
+      free(pl.jobs[i].out);
+    }
+
+  free(pl.jobs);
+
+  return 0;
+}
@@ -0,0 +1,325 @@
+//Separable Gaussian blur of PPM images
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "ppm.h"
+
+//Largest kernel radius (sigma up to ~10)
+#define BLUR_RMAX 32
+
+//
+typedef unsigned short u16;
+typedef unsigned int    u32;
+
+//Fixed point weights (8 fractional bits, sum 256): 255 * 256 still fits
+//an unsigned 16-bit lane, so every pass accumulates in 16 bits
+typedef struct {
+
+  int r;
+  u16 w[2 * BLUR_RMAX + 1];
+
+} kernel_t;
+
+//Horizontal pass: padded row (r pixels replicated on each side), n bytes out
+typedef void (*hpass_fn)(u8 *, u64, u8 *, const kernel_t *);
+
+//Vertical pass: 2r + 1 row pointers, bytes [lo, hi) of the output row
+typedef void (*vpass_fn)(u8 **, u64, u64, u8 *, const kernel_t *);
+
+//
+typedef struct {
+
+  ppm_t *in, *out;
+  const kernel_t *k;
+
+  //Rows [y0, y1) and width of the vertical strips in bytes
+  u64 y0, y1, strip;
+
+  //
+  hpass_fn h;
+  vpass_fn v;
+  pthread_t tid;
+
+} blur_thread_t;
+
+//Radius 3 sigma, weights rounded and the center fixed up so they sum to 256
+int kernel_gauss(kernel_t *k, double sigma)
+{
+  int r = (int)ceil(3.0 * sigma), sum = 0;
+  double g[2 * BLUR_RMAX + 1], s = 0.0;
+
+  if (sigma <= 0.0 || r > BLUR_RMAX)
+    return printf("Error: sigma must be in ]0, %.1lf]\n", BLUR_RMAX / 3.0), -1;
+
+  k->r = r;
+
+  for (int j = -r; j <= r; j++)
+    s += (g[j + r] = exp(-(j * j) / (2.0 * sigma * sigma)));
+
+  for (int j = 0; j <= 2 * r; j++)
+    sum += (k->w[j] = (u16)(256.0 * g[j] / s + 0.5));
+
+  k->w[r] += 256 - sum;
+
+  return 0;
+}
+
+//
+void hpass_c(u8 *pad, u64 n, u8 *out, const kernel_t *k)
+{
+  for (u64 i = 0; i < n; i++)
+    {
+      u32 s = 128;
+
+      for (int j = 0; j <= 2 * k->r; j++)
+	s += k->w[j] * pad[i + (3 * j)];
+
+      out[i] = s >> 8;
+    }
+}
+
+//
+void vpass_c(u8 **rows, u64 lo, u64 hi, u8 *out, const kernel_t *k)
+{
+  for (u64 i = lo; i < hi; i++)
+    {
+      u32 s = 128;
+
+      for (int j = 0; j <= 2 * k->r; j++)
+	s += k->w[j] * rows[j][i];
+
+      out[i] = s >> 8;
+    }
+}
+
+//Widens 32 bytes to 2 x 16 words, multiply-accumulates, and packs back
+//(vpackuswb works per lane, vpermq 0xd8 restores the byte order)
+#define MAC32(p, wj, lo, hi) do {					\
+    __m256i _v = _mm256_loadu_si256((__m256i *)(p));			\
+    lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(_v)), wj)); \
+    hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(_v, 1)), wj)); \
+  } while (0)
+
+#define PACK32(lo, hi) _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)), 0xd8)
+
+//Neighbour pixels are 3 bytes apart, each tap is an unaligned load of the row
+__attribute__((target("avx2")))
+void hpass_avx2(u8 *pad, u64 n, u8 *out, const kernel_t *k)
+{
+  const __m256i round = _mm256_set1_epi16(128);
+  u64 i = 0;
+
+  for (; i + 32 <= n; i += 32)
+    {
+      __m256i lo = round, hi = round;
+
+      for (int j = 0; j <= 2 * k->r; j++)
+	MAC32(pad + i + (3 * j), _mm256_set1_epi16(k->w[j]), lo, hi);
+
+      _mm256_storeu_si256((__m256i *)(out + i), PACK32(lo, hi));
+    }
+
+  hpass_c(pad + i, n - i, out + i, k);
+}
+
+//
+__attribute__((target("avx2")))
+void vpass_avx2(u8 **rows, u64 lo_, u64 hi_, u8 *out, const kernel_t *k)
+{
+  const __m256i round = _mm256_set1_epi16(128);
+  u64 i = lo_;
+
+  for (; i + 32 <= hi_; i += 32)
+    {
+      __m256i lo = round, hi = round;
+
+      for (int j = 0; j <= 2 * k->r; j++)
+	MAC32(rows[j] + i, _mm256_set1_epi16(k->w[j]), lo, hi);
+
+      _mm256_storeu_si256((__m256i *)(out + i), PACK32(lo, hi));
+    }
+
+  vpass_c(rows, i, hi_, out, k);
+}
+
+//Rows [y0, y1) of out. The horizontal pass fills a band buffer that has r
+//extra rows above and below (clamped to the image). The vertical pass then
+//goes down strips of columns, not whole rows: the 2r + 1 strip rows it
+//reads are reused by the next 2r output rows, and a strip is sized so that
+//they stay in L2 however wide the image is.
+void blur_band(ppm_t *in, ppm_t *out, const kernel_t *k, u64 y0, u64 y1, u64 strip, hpass_fn h, vpass_fn v)
+{
+  u64 r = k->r, w3 = in->w * 3;
+  u64 t0 = (y0 > r) ? y0 - r : 0, t1 = (y1 + r < in->h) ? y1 + r : in->h;
+  u8 *tmp = malloc((t1 - t0) * w3), *pad = malloc(w3 + (6 * r));
+  u8 *rows[2 * BLUR_RMAX + 1];
+
+  if (!tmp || !pad)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  //Horizontal, edge pixels replicated
+  for (u64 y = t0; y < t1; y++)
+    {
+      u8 *src = in->pixels + (y * w3);
+
+      for (u64 j = 0; j < r; j++)
+	{
+	  memcpy(pad + (3 * j), src, 3);
+	  memcpy(pad + w3 + (3 * (r + j)), src + w3 - 3, 3);
+	}
+
+      memcpy(pad + (3 * r), src, w3);
+
+      h(pad, w3, tmp + ((y - t0) * w3), k);
+    }
+
+  //Vertical, edge rows replicated
+  for (u64 x0 = 0; x0 < w3; x0 += strip)
+    {
+      u64 x1 = (x0 + strip < w3) ? x0 + strip : w3;
+
+      for (u64 y = y0; y < y1; y++)
+	{
+	  for (u64 j = 0; j <= 2 * r; j++)
+	    {
+	      long long yy = (long long)(y + j) - (long long)r;
+
+	      yy = (yy < 0) ? 0 : (yy >= (long long)in->h) ? in->h - 1 : yy;
+	      rows[j] = tmp + ((yy - t0) * w3);
+	    }
+
+	  v(rows, x0, x1, out->pixels + (y * w3), k);
+	}
+    }
+
+  free(tmp);
+  free(pad);
+}
+
+//Strip width in bytes: 2r + 2 strip rows (inputs and output) in half of L2
+u64 blur_strip(const kernel_t *k)
+{
+  long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  u64 s = ((l2 > 0) ? (u64)l2 : (256 << 10)) / 2 / (2 * k->r + 2);
+
+  return (s < 32) ? 32 : s & ~31ULL;
+}
+
+//
+void *_blur_(void *arg)
+{
+  blur_thread_t *t = arg;
+
+  blur_band(t->in, t->out, t->k, t->y0, t->y1, t->strip, t->h, t->v);
+
+  return NULL;
+}
+
+//Row bands: each thread blurs h / nt consecutive rows, recomputing the
+//horizontal pass of the r rows it shares with each neighbour
+void blur_threads(ppm_t *in, ppm_t *out, const kernel_t *k, u64 strip, u64 nt)
+{
+  blur_thread_t *t = malloc(nt * sizeof(blur_thread_t));
+  int avx2 = __builtin_cpu_supports("avx2");
+
+  if (!t)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].in = in;
+      t[i].out = out;
+      t[i].k = k;
+      t[i].y0 = (in->h * i) / nt;
+      t[i].y1 = (in->h * (i + 1)) / nt;
+      t[i].strip = strip;
+      t[i].h = avx2 ? hpass_avx2 : hpass_c;
+      t[i].v = avx2 ? vpass_avx2 : vpass_c;
+
+      pthread_create(&t[i].tid, NULL, _blur_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  free(t);
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+    return printf("Usage: %s [ppm input image] [ppm output image] [sigma] [threads] [strip bytes]\n", argv[0]), 1;
+
+  kernel_t k;
+
+  if (kernel_gauss(&k, atof(argv[3])) < 0)
+    return 2;
+
+  u64 nt = (argc > 4) ? atoll(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
+  ppm_t *in = map_ppm(argv[1]);
+
+  if (!in)
+    exit(-1);
+
+  u64 n = in->w * in->h, w3 = in->w * 3;
+  u64 strip = (argc > 5) ? atoll(argv[5]) : blur_strip(&k);
+
+  if (!strip)
+    strip = w3;
+
+  ppm_t *ref = create_ppm(in->w, in->h, in->t), *out = create_ppm(in->w, in->h, in->t);
+
+  if (!ref || !out)
+    exit(-1);
+
+  //First touch outside of the timings
+  memset(ref->pixels, 0, n * 3);
+  memset(out->pixels, 0, n * 3);
+
+  printf("%llux%llu, sigma %s (radius %d), strip %llu bytes\n", in->w, in->h, argv[3], k.r, strip);
+
+  double b = now();
+  blur_band(in, ref, &k, 0, in->h, strip, hpass_c, vpass_c);
+  double a = now();
+
+  printf("blur_c              : %.3lf ms, %8.1lf Mpixel/s\n", (a - b) * 1e3, n / (a - b) / 1e6);
+
+  for (int m = 0; m < 3; m++)
+    {
+      const char *name[] = { "blur_avx2 (rows)    ", "blur_avx2 (strips)  ", "blur_threads        " };
+
+      if (m < 2 && !__builtin_cpu_supports("avx2"))
+	continue;
+
+      memset(out->pixels, 0, n * 3);
+
+      b = now();
+
+      if (m == 2)
+	blur_threads(in, out, &k, strip, nt);
+      else
+	blur_band(in, out, &k, 0, in->h, m ? strip : w3, hpass_avx2, vpass_avx2);
+
+      a = now();
+
+      printf("%s: %.3lf ms, %8.1lf Mpixel/s %s\n", name[m], (a - b) * 1e3, n / (a - b) / 1e6,
+	     memcmp(out->pixels, ref->pixels, n * 3) ? "(MISMATCH)" : "");
+    }
+
+  write_ppm_pwrite(out, argv[2]);
+
+  release_ppm(in); free(in);
+  release_ppm(ref); free(ref);
+  release_ppm(out); free(out);
+
+  return 0;
+}
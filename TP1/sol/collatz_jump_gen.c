@@ -0,0 +1,86 @@
+//Generates the k-step Collatz jump table header used by 1.c
+//
+//    $ ./collatz_jump_gen [k] > collatz_jump.h     (8 <= k <= 16)
+//
+//Writing n = 2^k * a + r with r the k low bits of n, k shortcut steps
+//(n / 2 if n is even, (3n + 1) / 2 if n is odd) give 3^c * a + d, where
+//c is the number of odd steps met while walking r and d = T^k(r).
+//Entry r of the table holds (3^c, d, k + c), k + c being the number of
+//regular Collatz steps the jump accounts for.
+#include <stdio.h>
+#include <stdlib.h>
+
+//
+typedef unsigned long long u64;
+
+//Same count as collatz_c in 1.c
+u64 collatz_len(u64 n)
+{
+  u64 i = 1;
+
+  while (n != 1)
+    {
+      n = (n & 1) ? (3 * n) + 1 : n / 2;
+      i++;
+    }
+
+  return i;
+}
+
+//
+int main(int argc, char **argv)
+{
+  //
+  if (argc < 2)
+    return printf("Usage: %s [k]\n", argv[0]), 1;
+
+  //
+  u64 k = atoll(argv[1]);
+
+  if (k < 8 || k > 16)
+    return printf("Error: k must be in [8, 16]\n"), 2;
+
+  //
+  u64 size = 1ULL << k;
+
+  printf("//Generated by '%s %llu', do not edit\n", argv[0], k);
+  printf("#pragma once\n\n");
+  printf("//\n#define COLLATZ_K %llu\n\n", k);
+  
+  //Jump table
+  printf("//{ 3^c, T^k(r), k + c } for each k low bits value r\n");
+  printf("static const collatz_jump_t collatz_jump[%llu] = {\n", size);
+
+  for (u64 r = 0; r < size; r++)
+    {
+      u64 m = 1;
+      u64 c = 0;
+      u64 d = r;
+
+      for (u64 j = 0; j < k; j++)
+	if (d & 1)
+	  {
+	    d = (3 * d + 1) / 2;
+	    m *= 3;
+	    c++;
+	  }
+	else
+	  d /= 2;
+      
+      printf("  { %llu, %llu, %llu },%c", m, d, k + c, ((r + 1) % 4) ? ' ' : '\n');
+    }
+
+  printf("};\n\n");
+
+  //Lengths of the values below 2^k, used to finish a walk in one lookup
+  printf("//collatz_c(v) for v < 2^k (entry 0 unused)\n");
+  printf("static const u16 collatz_small[%llu] = {\n", size);
+
+  for (u64 v = 0; v < size; v++)
+    printf("  %llu,%c", v ? collatz_len(v) : 0, ((v + 1) % 16) ? ' ' : '\n');
+
+  printf("};\n");
+  
+  //
+  return 0;
+}
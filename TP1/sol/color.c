@@ -0,0 +1,281 @@
+//RGB to grayscale / planar YUV conversion of PPM images
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "ppm.h"
+
+//
+typedef signed char i8;
+
+//Fixed point conversion, 7 fractional bits so every weight fits the signed
+//byte operand of vpmaddubsw: out = ((wr R + wg G + wb B + 64) >> 7) + bias
+typedef struct {
+
+  //Number of output planes
+  int n;
+
+  //Weights and bias of each plane
+  i8 w[3][3];
+  int bias[3];
+
+} conv_t;
+
+//BT.601 luma: 0.299, 0.587, 0.114
+const conv_t conv_gray = { 1, { { 38, 75, 15 } }, { 0 } };
+
+//BT.601 full range Y, Cb, Cr (JPEG)
+const conv_t conv_yuv = { 3, { { 38, 75, 15 }, { -22, -42, 64 }, { 64, -54, -10 } }, { 0, 128, 128 } };
+
+//
+typedef void (*conv_fn)(u8 *, u64, const conv_t *, u8 **);
+
+//
+typedef struct {
+
+  //Pixels [lo, hi) of the image
+  u8 *rgb;
+  u64 lo, hi;
+
+  //
+  const conv_t *c;
+  u8 **out;
+
+  //
+  conv_fn f;
+  pthread_t tid;
+
+} conv_thread_t;
+
+//Reference
+void convert_c(u8 *rgb, u64 n, const conv_t *c, u8 **out)
+{
+  for (u64 i = 0; i < n; i++)
+    {
+      u8 *p = rgb + (3 * i);
+
+      for (int k = 0; k < c->n; k++)
+	{
+	  int v = ((c->w[k][0] * p[0] + c->w[k][1] * p[1] + c->w[k][2] * p[2] + 64) >> 7) + c->bias[k];
+
+	  out[k][i] = (v < 0) ? 0 : (v > 255) ? 255 : v;
+	}
+    }
+}
+
+//16 pixels per iteration. Four unaligned 16 byte loads starting every 12
+//bytes put 4 whole pixels at the bottom of each 128-bit lane, vpshufb turns
+//them into (R, G) pairs followed by (B, 0) pairs, and vpmaddubsw against
+//(wr, wg) / (wb, 0) leaves two partial sums per pixel that one more add
+//folds. The pack and vpermd put the 16 results back in pixel order.
+__attribute__((target("avx2")))
+void convert_avx2(u8 *rgb, u64 n, const conv_t *c, u8 **out)
+{
+  const __m256i split = _mm256_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 2, -1, 5, -1, 8, -1, 11, -1,
+					 0, 1, 3, 4, 6, 7, 9, 10, 2, -1, 5, -1, 8, -1, 11, -1);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  const __m256i round = _mm256_set1_epi16(64);
+  __m256i w[3], bias[3];
+  u64 i = 0;
+
+  for (int k = 0; k < c->n; k++)
+    {
+      i8 wr = c->w[k][0], wg = c->w[k][1], wb = c->w[k][2];
+
+      w[k] = _mm256_setr_epi8(wr, wg, wr, wg, wr, wg, wr, wg, wb, 0, wb, 0, wb, 0, wb, 0,
+			      wr, wg, wr, wg, wr, wg, wr, wg, wb, 0, wb, 0, wb, 0, wb, 0);
+      bias[k] = _mm256_set1_epi16(c->bias[k]);
+    }
+
+  //The last load reads 4 bytes past the 16 pixels: keep 2 pixels of margin
+  for (; i + 18 <= n; i += 16)
+    {
+      u8 *p = rgb + (3 * i);
+      __m256i a = _mm256_shuffle_epi8(_mm256_loadu2_m128i((__m128i *)(p + 12), (__m128i *)p), split);
+      __m256i b = _mm256_shuffle_epi8(_mm256_loadu2_m128i((__m128i *)(p + 36), (__m128i *)(p + 24)), split);
+
+      for (int k = 0; k < c->n; k++)
+	{
+	  __m256i sa = _mm256_maddubs_epi16(a, w[k]);
+	  __m256i sb = _mm256_maddubs_epi16(b, w[k]);
+
+	  //(R, G) sums + B sums, valid in the low 64 bits of each lane
+	  sa = _mm256_add_epi16(sa, _mm256_shuffle_epi32(sa, 0x4e));
+	  sb = _mm256_add_epi16(sb, _mm256_shuffle_epi32(sb, 0x4e));
+
+	  __m256i y = _mm256_unpacklo_epi64(sa, sb);
+
+	  y = _mm256_add_epi16(_mm256_srai_epi16(_mm256_add_epi16(y, round), 7), bias[k]);
+	  y = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y, y), order);
+
+	  _mm_storeu_si128((__m128i *)(out[k] + i), _mm256_castsi256_si128(y));
+	}
+    }
+
+  if (i < n)
+    {
+      u8 *tail[3] = { out[0] + i, (c->n > 1) ? out[1] + i : NULL, (c->n > 2) ? out[2] + i : NULL };
+
+      convert_c(rgb + (3 * i), n - i, c, tail);
+    }
+}
+
+//
+void *_convert_(void *arg)
+{
+  conv_thread_t *t = arg;
+  u8 *out[3];
+
+  for (int k = 0; k < t->c->n; k++)
+    out[k] = t->out[k] + t->lo;
+
+  t->f(t->rgb + (3 * t->lo), t->hi - t->lo, t->c, out);
+
+  return NULL;
+}
+
+//Row bands: each thread converts h / nt consecutive rows
+void convert_threads(ppm_t *p, const conv_t *c, u8 **out, u64 nt)
+{
+  conv_thread_t *t = malloc(nt * sizeof(conv_thread_t));
+
+  if (!t)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].rgb = p->pixels;
+      t[i].lo = ((p->h * i) / nt) * p->w;
+      t[i].hi = ((p->h * (i + 1)) / nt) * p->w;
+      t[i].c = c;
+      t[i].out = out;
+      t[i].f = __builtin_cpu_supports("avx2") ? convert_avx2 : convert_c;
+
+      pthread_create(&t[i].tid, NULL, _convert_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  free(t);
+}
+
+//Header (may be empty) and planes in as few system calls as possible
+int write_planes(const char *fname, const char *hdr, u8 **planes, int np, u64 size)
+{
+  struct iovec iov[4];
+  int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    return printf("Error: cannot create file '%s'\n", fname), -1;
+
+  iov[0].iov_base = (void *)hdr;
+  iov[0].iov_len = strlen(hdr);
+
+  for (int k = 0; k < np; k++)
+    {
+      iov[k + 1].iov_base = planes[k];
+      iov[k + 1].iov_len = size;
+    }
+
+  if (pwritev_all(fd, iov, np + 1, 0) < 0)
+    return close(fd), printf("Error: cannot write file '%s'\n", fname), -1;
+
+  close(fd);
+
+  return 0;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+    return printf("Usage: %s gray [ppm input image] [pgm output image] [threads]\n"
+		  "       %s yuv [ppm input image] [planar yuv 4:4:4 output] [threads]\n", argv[0], argv[0]), 1;
+
+  const conv_t *c;
+
+  if (!strcmp(argv[1], "gray"))
+    c = &conv_gray;
+  else
+    if (!strcmp(argv[1], "yuv"))
+      c = &conv_yuv;
+    else
+      return printf("Error: unknown conversion '%s'\n", argv[1]), 1;
+
+  u64 nt = (argc > 4) ? atoll(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
+  ppm_t *p = map_ppm(argv[2]);
+
+  if (!p)
+    exit(-1);
+
+  u64 n = p->w * p->h;
+  u8 *ref[3], *out[3];
+
+  for (int k = 0; k < c->n; k++)
+    {
+      ref[k] = malloc(n);
+      out[k] = malloc(n);
+
+      if (!ref[k] || !out[k])
+	return printf("Error: cannot allocate memory\n"), 3;
+
+      //First touch outside of the timings
+      memset(out[k], 0, n);
+      memset(ref[k], 0, n);
+    }
+
+  double b = now();
+  convert_c(p->pixels, n, c, ref);
+  double a = now();
+
+  printf("convert_c      : %.3lf ms, %8.1lf Mpixel/s\n", (a - b) * 1e3, n / (a - b) / 1e6);
+
+  for (int v = 0; v < 2; v++)
+    {
+      if (!v && !__builtin_cpu_supports("avx2"))
+	continue;
+
+      b = now();
+
+      if (v)
+	convert_threads(p, c, out, nt);
+      else
+	convert_avx2(p->pixels, n, c, out);
+
+      a = now();
+
+      int ok = 1;
+
+      for (int k = 0; k < c->n; k++)
+	ok &= !memcmp(out[k], ref[k], n);
+
+      printf("%s: %.3lf ms, %8.1lf Mpixel/s %s\n", v ? "convert_threads" : "convert_avx2   ",
+	     (a - b) * 1e3, n / (a - b) / 1e6, ok ? "" : "(MISMATCH)");
+    }
+
+  //P5 for gray, raw Y, U, V planes for yuv
+  char hdr[64] = "";
+
+  if (c->n == 1)
+    snprintf(hdr, sizeof(hdr), "P5\n%llu %llu\n255\n", p->w, p->h);
+
+  if (write_planes(argv[3], hdr, out, c->n, n) < 0)
+    return 4;
+
+  for (int k = 0; k < c->n; k++)
+    {
+      free(ref[k]);
+      free(out[k]);
+    }
+
+  release_ppm(p); free(p);
+
+  return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+//Packed 2-bit DNA: 4 bases per byte, base i sits in bits 2 * (i % 4) of byte i / 4.
+//The code of a base is (ascii >> 1) & 3, so no table is needed to convert:
+//A (0x41) -> 0, C (0x43) -> 1, T (0x54) -> 2, G (0x47) -> 3, and the
+//complement of a code is code ^ 2.
+
+//File layout: 8 byte magic, base count (64-bit little endian), then
+//(len + 3) / 4 bytes with the unused bits of the last byte set to 0
+#define DNA2_MAGIC "DNA2PACK"
+#define DNA2_HDR   16
+
+//
+#define DNA2_CODE(c) (((c) >> 1) & 3)
+
+//Code to ascii
+#define DNA2_BASES "ACTG"
@@ -0,0 +1,181 @@
+#pragma once
+
+//Pixel filters, all of them take (in, len, out) and work in place when in == out
+#include <math.h>
+#include <immintrin.h>
+
+#include "ppm.h"
+
+//Inverts the pixels
+//这是一个C语言函数，用于将输入数组 in 中的每个元素逐个反转，并将结果存储在输出数组 out 中。
+//反转的方式是将每个元素减去255，这实际上是对8位无符号整数进行求补操作。该函数用于颠倒颜色值或将图像进行反色处理。
+void invert_c(u8 *in, u64 len, u8 *out)
+{
+  //u8 *in: 输入数组，包含待反转的元素。
+  //u64 len: 输入数组的长度，即要处理的元素个数。
+  //u8 *out: 输出数组，用于存储反转后的结果。
+  for (u64 i = 0; i < len; i++)
+    out[i] = 255 - in[i];
+} //函数遍历输入数组中的每个元素，将每个元素的值减去255，然后将结果存储在输出数组中。
+  //这将导致颜色值从255减到0，从0减到255，实现了颜色的反转。
+
+
+//8 bytes per iteration, the len % 8 tail goes through invert_c
+void invert_asm(u8 *in, u64 len, u8 *out)
+{
+  //这是一个使用内联汇编的C函数，用于将输入数组 in 中的每个8字节的元素逐个反转，并将结果存储在输出数组 out 中。
+  //这是一种高效的反转操作，将输入的8字节值的每个位都进行翻转（0变为1，1变为0）。
+  u64 n = len & ~7ULL;
+
+  if (n)
+  __asm__ volatile(
+		   "xor %%rcx, %%rcx;\n" //该函数使用了x86_64体系结构的汇编指令。在循环中，它依次处理输入数组中的每个8字节元素（64位元素）。
+
+		   "1:;\n"
+
+		   "movq (%[_in], %%rcx), %%rax;\n"   //使用movq指令将输入数组中的8字节元素加载到寄存器rax中。
+		   "not %%rax;\n"                     //使用not指令对rax中的值进行按位取反操作，实现了反转。
+		   "movq %%rax, (%[_out], %%rcx);\n"  //使用movq指令将结果存储回输出数组中。
+		   
+		   "add $8, %%rcx;\n"      //增加一个偏移，以处理下一个8字节元素，直到处理完整个数组。
+		   "cmp %[_s], %%rcx;\n"
+		   "jl 1b;\n"
+		   
+		   : //outputs
+
+		   : //inputs
+		     [_in]  "r" (in),
+		     [_out] "r" (out),
+		     [_s]   "r" (n)
+		     
+		   : //clobber
+		     "cc", "memory", "rax", "rcx"
+		   );  //这个函数实现了高效的位级别反转，通常用于需要快速处理大型数据的应用程序
+
+  invert_c(in + n, len - n, out + n);
+}
+
+//AVX2 invert, 32 bytes per iteration and any length (the tail goes through invert_c)
+__attribute__((target("avx2")))
+void invert_avx2(u8 *in, u64 len, u8 *out)
+{
+  const __m256i ones = _mm256_set1_epi8(-1);
+  u64 i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(in + i)), ones));
+
+  invert_c(in + i, len - i, out + i);
+}
+
+//
+void invert(u8 *in, u64 len, u8 *out)
+{
+  if (__builtin_cpu_supports("avx2"))
+    invert_avx2(in, len, out);
+  else
+    invert_c(in, len, out);
+}
+
+//Byte tables: out[i] = lut[in[i]], any 256 entry table (see the lut_* presets)
+void lut_c(u8 *in, u64 len, u8 *out, const u8 *lut)
+{
+  for (u64 i = 0; i < len; i++)
+    out[i] = lut[in[i]];
+}
+
+//vpshufb only looks up 16 entries, so the table is read as 16 rows of 16.
+//Row h is looked up with x - 16 h saturated + 0x70: bytes of that row get
+//their low nibble with bit 7 clear, every other byte gets bit 7 set (0 out).
+//The 16 lookups are ORed together.
+__attribute__((target("avx2")))
+void lut_avx2(u8 *in, u64 len, u8 *out, const u8 *lut)
+{
+  const __m256i step = _mm256_set1_epi8(0x10), bias = _mm256_set1_epi8(0x70);
+  __m256i rows[16];
+  u64 i = 0;
+
+  for (int h = 0; h < 16; h++)
+    rows[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)(lut + (16 * h))));
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m256i x = _mm256_loadu_si256((__m256i *)(in + i));
+      __m256i r = _mm256_setzero_si256();
+
+      for (int h = 0; h < 16; h++)
+	{
+	  r = _mm256_or_si256(r, _mm256_shuffle_epi8(rows[h], _mm256_adds_epu8(x, bias)));
+	  x = _mm256_sub_epi8(x, step);
+	}
+
+      _mm256_storeu_si256((__m256i *)(out + i), r);
+    }
+
+  lut_c(in + i, len - i, out + i, lut);
+}
+
+//The table fits in 4 zmm: vpermi2b looks up 128 entries with the low 7 bits,
+//bit 7 picks the half. The tail is a masked load / store.
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void lut_avx512(u8 *in, u64 len, u8 *out, const u8 *lut)
+{
+  const __m512i t0 = _mm512_loadu_si512(lut), t1 = _mm512_loadu_si512(lut + 64);
+  const __m512i t2 = _mm512_loadu_si512(lut + 128), t3 = _mm512_loadu_si512(lut + 192);
+  u64 i = 0;
+
+  for (; i < len; i += 64)
+    {
+      __mmask64 m = (len - i >= 64) ? ~0ULL : (1ULL << (len - i)) - 1;
+      __m512i x = _mm512_maskz_loadu_epi8(m, in + i);
+      __m512i lo = _mm512_permutex2var_epi8(t0, x, t1);
+      __m512i hi = _mm512_permutex2var_epi8(t2, x, t3);
+
+      _mm512_mask_storeu_epi8(out + i, m, _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi));
+    }
+}
+
+//
+void lut_apply(u8 *in, u64 len, u8 *out, const u8 *lut)
+{
+  if (__builtin_cpu_supports("avx512vbmi"))
+    lut_avx512(in, len, out, lut);
+  else
+    if (__builtin_cpu_supports("avx2"))
+      lut_avx2(in, len, out, lut);
+    else
+      lut_c(in, len, out, lut);
+}
+
+//Presets
+
+//255 - x
+void lut_invert(u8 *lut)
+{
+  for (int i = 0; i < 256; i++)
+    lut[i] = 255 - i;
+}
+
+//255 (x / 255) ^ g, g < 1 brightens and g > 1 darkens
+void lut_gamma(u8 *lut, double g)
+{
+  for (int i = 0; i < 256; i++)
+    lut[i] = (u8)(255.0 * pow(i / 255.0, g) + 0.5);
+}
+
+//0 below t, 255 from t on
+void lut_threshold(u8 *lut, u8 t)
+{
+  for (int i = 0; i < 256; i++)
+    lut[i] = (i >= t) ? 255 : 0;
+}
+
+//[lo, hi] stretched to [0, 255], clamped outside
+void lut_stretch(u8 *lut, u8 lo, u8 hi)
+{
+  for (int i = 0; i < 256; i++)
+    if (hi <= lo)
+      lut[i] = i;
+    else
+      lut[i] = (i <= lo) ? 0 : (i >= hi) ? 255 : ((255 * (i - lo)) + ((hi - lo) / 2)) / (hi - lo);
+}
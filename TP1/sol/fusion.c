@@ -0,0 +1,414 @@
+//Kernel fusion for the TP1 array kernels (scale from 3.c, dotprod from 4.c)
+//
+//A pipeline is a list of element-wise stages (scale, add, invert) ended by a
+//reduction (sum, dot). Run unfused, every stage is a full pass over memory;
+//fused, the data is streamed once in L1-sized blocks and all the stages and
+//the reduction are applied to a block before moving to the next one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <immintrin.h>
+
+//
+typedef unsigned long long u64;
+
+//Block of ints processed by all the stages while it sits in L1 (4 KiB)
+#define FUSE_BLOCK 1024
+
+//
+#define FUSE_MAX_STAGES 16
+
+//Element-wise stages
+typedef enum { OP_SCALE, OP_ADD, OP_INVERT } stage_op_t;
+
+//Terminal reductions
+typedef enum { RED_NONE, RED_SUM, RED_DOT } reduce_op_t;
+
+//
+typedef struct {
+
+  stage_op_t op;
+
+  //Scaling factor (OP_SCALE)
+  int s;
+
+  //Array added element-wise (OP_ADD)
+  const int *q;
+  
+} stage_t;
+
+//
+typedef struct {
+
+  //Stages, applied in order
+  stage_t stage[FUSE_MAX_STAGES];
+  u64 ns;
+
+  //Reduction and its second operand (RED_DOT)
+  reduce_op_t red;
+  const int *b;
+
+  //If not NULL, the output of the last stage is written there (may be the input)
+  int *store;
+  
+} pipeline_t;
+
+//
+void pipeline_init(pipeline_t *pl)
+{
+  memset(pl, 0, sizeof(pipeline_t));
+}
+
+//
+static void pipeline_push(pipeline_t *pl, stage_op_t op, int s, const int *q)
+{
+  if (pl->ns == FUSE_MAX_STAGES)
+    printf("Error: too many stages (max %d)\n", FUSE_MAX_STAGES), exit(-1);
+
+  pl->stage[pl->ns].op = op;
+  pl->stage[pl->ns].s  = s;
+  pl->stage[pl->ns].q  = q;
+  pl->ns++;
+}
+
+//x *= s
+void pipeline_scale(pipeline_t *pl, int s)
+{
+  pipeline_push(pl, OP_SCALE, s, NULL);
+}
+
+//x += q[i]
+void pipeline_add(pipeline_t *pl, const int *q)
+{
+  pipeline_push(pl, OP_ADD, 0, q);
+}
+
+//x = ~x (bitwise, like invert_asm in 6.c)
+void pipeline_invert(pipeline_t *pl)
+{
+  pipeline_push(pl, OP_INVERT, 0, NULL);
+}
+
+//Result is sum(x[i])
+void pipeline_sum(pipeline_t *pl)
+{
+  pl->red = RED_SUM;
+}
+
+//Result is sum(x[i] * b[i]), 64-bit products
+void pipeline_dot(pipeline_t *pl, const int *b)
+{
+  pl->red = RED_DOT;
+  pl->b   = b;
+}
+
+//
+// Stage and reduction kernels: i is the offset of the block in the arrays
+//
+
+//Scalar versions
+static void stage_c(const stage_t *st, int *dst, const int *src, u64 i, u64 len)
+{
+  switch (st->op)
+    {
+    case OP_SCALE:
+      for (u64 j = 0; j < len; j++)
+	dst[j] = src[j] * st->s;
+      break;
+
+    case OP_ADD:
+      for (u64 j = 0; j < len; j++)
+	dst[j] = src[j] + st->q[i + j];
+      break;
+
+    case OP_INVERT:
+      for (u64 j = 0; j < len; j++)
+	dst[j] = ~src[j];
+      break;
+    }
+}
+
+//
+static long long reduce_c(reduce_op_t red, const int *x, const int *b, u64 len)
+{
+  long long r = 0;
+
+  if (red == RED_SUM)
+    for (u64 j = 0; j < len; j++)
+      r += x[j];
+  else
+    if (red == RED_DOT)
+      for (u64 j = 0; j < len; j++)
+	r += (long long)x[j] * b[j];
+
+  return r;
+}
+
+//AVX2 versions, scalar tail
+__attribute__((target("avx2")))
+static void stage_avx2(const stage_t *st, int *dst, const int *src, u64 i, u64 len)
+{
+  u64 j = 0;
+  
+  switch (st->op)
+    {
+    case OP_SCALE:
+      {
+	const __m256i vs = _mm256_set1_epi32(st->s);
+	
+	for (; j + 8 <= len; j += 8)
+	  _mm256_storeu_si256((__m256i *)(dst + j),
+			      _mm256_mullo_epi32(_mm256_loadu_si256((__m256i *)(src + j)), vs));
+	break;
+      }
+      
+    case OP_ADD:
+      for (; j + 8 <= len; j += 8)
+	_mm256_storeu_si256((__m256i *)(dst + j),
+			    _mm256_add_epi32(_mm256_loadu_si256((__m256i *)(src + j)),
+					     _mm256_loadu_si256((__m256i *)(st->q + i + j))));
+      break;
+
+    case OP_INVERT:
+      {
+	const __m256i ones = _mm256_set1_epi32(-1);
+	
+	for (; j + 8 <= len; j += 8)
+	  _mm256_storeu_si256((__m256i *)(dst + j),
+			      _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(src + j)), ones));
+	break;
+      }
+    }
+
+  if (j < len)
+    stage_c(st, dst + j, src + j, i + j, len - j);
+}
+
+//Sums are widened to 64 bits (vpmovsxdq), dot products use vpmuldq on the even
+//lanes and on the odd lanes shifted down
+__attribute__((target("avx2")))
+static long long reduce_avx2(reduce_op_t red, const int *x, const int *b, u64 len)
+{
+  u64 j = 0;
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+
+  if (red == RED_SUM)
+    for (; j + 8 <= len; j += 8)
+      {
+	acc0 = _mm256_add_epi64(acc0, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *)(x + j))));
+	acc1 = _mm256_add_epi64(acc1, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *)(x + j + 4))));
+      }
+  else
+    if (red == RED_DOT)
+      for (; j + 8 <= len; j += 8)
+	{
+	  __m256i vx = _mm256_loadu_si256((__m256i *)(x + j));
+	  __m256i vb = _mm256_loadu_si256((__m256i *)(b + j));
+
+	  acc0 = _mm256_add_epi64(acc0, _mm256_mul_epi32(vx, vb));
+	  acc1 = _mm256_add_epi64(acc1, _mm256_mul_epi32(_mm256_srli_epi64(vx, 32), _mm256_srli_epi64(vb, 32)));
+	}
+    else
+      return 0;
+
+  long long t[4];
+
+  _mm256_storeu_si256((__m256i *)t, _mm256_add_epi64(acc0, acc1));
+
+  return t[0] + t[1] + t[2] + t[3] + reduce_c(red, x + j, b ? b + j : NULL, len - j);
+}
+
+//
+static int use_avx2 = -1;
+
+//
+static void stage(const stage_t *st, int *dst, const int *src, u64 i, u64 len)
+{
+  if (use_avx2)
+    stage_avx2(st, dst, src, i, len);
+  else
+    stage_c(st, dst, src, i, len);
+}
+
+//
+static long long reduce(reduce_op_t red, const int *x, const int *b, u64 len)
+{
+  return use_avx2 ? reduce_avx2(red, x, b, len) : reduce_c(red, x, b, len);
+}
+
+//Fused run: each block of a goes through all the stages in an L1 buffer (the
+//last stage writes straight to store when set) and is reduced right away.
+//a is read once, store written once, and the operands of add/dot read once.
+long long pipeline_run(const pipeline_t *pl, const int *a, u64 n)
+{
+  int tmp[FUSE_BLOCK] __attribute__((aligned(64)));
+  long long r = 0;
+
+  if (use_avx2 < 0)
+    use_avx2 = __builtin_cpu_supports("avx2");
+  
+  for (u64 i = 0; i < n; i += FUSE_BLOCK)
+    {
+      u64 len = (n - i < FUSE_BLOCK) ? n - i : FUSE_BLOCK;
+      const int *x = a + i;
+
+      for (u64 k = 0; k < pl->ns; k++)
+	{
+	  int *dst = (k == pl->ns - 1 && pl->store) ? pl->store + i : tmp;
+	  
+	  stage(&pl->stage[k], dst, x, i, len);
+	  x = dst;
+	}
+
+      //No stage: plain copy
+      if (!pl->ns && pl->store && pl->store + i != a + i)
+	memcpy(pl->store + i, x, sizeof(int) * len);
+	
+      r += reduce(pl->red, x, pl->b ? pl->b + i : NULL, len);
+    }
+
+  return r;
+}
+
+//Unfused reference: the stages run one after the other over the whole array,
+//in place in a, then the reduction makes a last pass (a must be writable)
+long long pipeline_run_unfused(const pipeline_t *pl, int *a, u64 n)
+{
+  if (use_avx2 < 0)
+    use_avx2 = __builtin_cpu_supports("avx2");
+
+  for (u64 k = 0; k < pl->ns; k++)
+    stage(&pl->stage[k], a, a, 0, n);
+
+  return reduce(pl->red, a, pl->b, n);
+}
+
+//Bytes moved through memory by a fused and an unfused run
+void pipeline_traffic(const pipeline_t *pl, u64 n, u64 *fused, u64 *unfused)
+{
+  u64 f = 1, u = 0;
+  
+  //Stages: in place read + write each, plus the added array
+  for (u64 k = 0; k < pl->ns; k++)
+    {
+      u += 2;
+
+      if (pl->stage[k].op == OP_ADD)
+	u++, f++;
+    }
+
+  //Reduction
+  u++;
+  
+  if (pl->red == RED_DOT)
+    u++, f++;
+
+  if (pl->store)
+    f++;
+  
+  *fused   = f * n * sizeof(int);
+  *unfused = u * n * sizeof(int);
+}
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//
+void init(int *a, int *q, int *b, u64 n)
+{
+  for (u64 i = 0; i < n; i++)
+    {
+      a[i] = i + 1;
+      q[i] = i % 7;
+      b[i] = i - 1;
+    }
+}
+
+//Times both runs of pl, a is reset between runs (untimed)
+void bench(const char *name, pipeline_t *pl, int *a, int *q, int *b, u64 n, u64 reps)
+{
+  double e_f = 0.0, e_u = 0.0;
+  long long r_f = 0, r_u = 0;
+  u64 t_f, t_u;
+
+  for (u64 r = 0; r < reps; r++)
+    {
+      init(a, q, b, n);
+
+      double t0 = now();
+      r_u = pipeline_run_unfused(pl, a, n);
+      double t1 = now();
+      
+      init(a, q, b, n);
+
+      double t2 = now();
+      r_f = pipeline_run(pl, a, n);
+      double t3 = now();
+
+      e_u += t1 - t0;
+      e_f += t3 - t2;
+    }
+
+  pipeline_traffic(pl, n, &t_f, &t_u);
+  
+  printf("%s\n", name);
+  printf("  unfused: %10.6lf s, %8.2lf MiB moved, result %lld\n", e_u / reps, t_u / 1048576.0, r_u);
+  printf("  fused  : %10.6lf s, %8.2lf MiB moved, result %lld %s\n", e_f / reps, t_f / 1048576.0, r_f,
+	 (r_f != r_u) ? "(MISMATCH)" : "");
+  printf("  speedup: %.2lf\n", e_u / e_f);
+}
+
+//
+int main(int argc, char **argv)
+{
+  //
+  if (argc < 2)
+    return printf("Usage: %s [n] [reps]\n", argv[0]), 1;
+
+  //
+  u64 n    = atoll(argv[1]);
+  u64 reps = (argc > 2) ? atoll(argv[2]) : 5;
+
+  if (!n || !reps)
+    return printf("Error: 'n' and 'reps' must be > 0\n"), 2;
+  
+  int *a = malloc(sizeof(int) * n);
+  int *q = malloc(sizeof(int) * n);
+  int *b = malloc(sizeof(int) * n);
+
+  if (!a || !q || !b)
+    return printf("Error: cannot allocate memory\n"), 3;
+
+  pipeline_t pl;
+
+  //3.c then 4.c: scale, then dot product
+  pipeline_init(&pl);
+  pipeline_scale(&pl, 3);
+  pipeline_dot(&pl, b);
+  bench("scale(3) -> dot(b)", &pl, a, q, b, n, reps);
+
+  //Longer chain, the scaled values are kept
+  pipeline_init(&pl);
+  pipeline_scale(&pl, 3);
+  pipeline_add(&pl, q);
+  pipeline_invert(&pl);
+  pipeline_sum(&pl);
+  pl.store = a;
+  bench("scale(3) -> add(q) -> invert -> sum, stored", &pl, a, q, b, n, reps);
+  
+  free(a);
+  free(q);
+  free(b);
+  
+  //
+  return 0;
+}
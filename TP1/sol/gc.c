@@ -0,0 +1,288 @@
+//Base composition and GC content of a sequence
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "seq.h"
+
+//Counter order
+#define BASE_A 0
+#define BASE_C 1
+#define BASE_G 2
+#define BASE_T 3
+
+//
+typedef void (*count_fn)(u8 *, u64, u64 *);
+
+//
+typedef struct {
+
+  //Range of the sequence
+  u8 *s;
+  u64 n;
+
+  //Counts of A, C, G, T
+  u64 cnt[4];
+
+  //Profile mode: block counts of G + C for blocks [b0, b1)
+  u64 step, b0, b1, *gc;
+
+  //
+  count_fn f;
+  pthread_t tid;
+
+} count_thread_t;
+
+//Counts A, C, G, T, lower case included (soft-masked regions), anything
+//else (N, newlines) is ignored
+void count_c(u8 *s, u64 n, u64 *cnt)
+{
+  u64 c[256] = { 0 };
+
+  for (u64 i = 0; i < n; i++)
+    c[s[i] | 0x20]++;
+
+  cnt[BASE_A] = c['a'];
+  cnt[BASE_C] = c['c'];
+  cnt[BASE_G] = c['g'];
+  cnt[BASE_T] = c['t'];
+}
+
+//32 bytes per iteration compared to each base, the -1 of vpcmpeqb are
+//subtracted from byte counters that are folded into 64-bit lanes with
+//vpsadbw every 255 iterations, before they can wrap
+__attribute__((target("avx2")))
+void count_avx2(u8 *s, u64 n, u64 *cnt)
+{
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i va = _mm256_set1_epi8('a'), vc = _mm256_set1_epi8('c');
+  const __m256i vg = _mm256_set1_epi8('g'), vt = _mm256_set1_epi8('t');
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sa = zero, sc = zero, sg = zero, st = zero;
+  u64 i = 0;
+
+  while (i + 32 <= n)
+    {
+      __m256i ca = zero, cc = zero, cg = zero, ct = zero;
+
+      for (u64 j = 0; j < 255 && i + 32 <= n; j++, i += 32)
+	{
+	  __m256i v = _mm256_or_si256(_mm256_loadu_si256((__m256i *)(s + i)), lower);
+
+	  ca = _mm256_sub_epi8(ca, _mm256_cmpeq_epi8(v, va));
+	  cc = _mm256_sub_epi8(cc, _mm256_cmpeq_epi8(v, vc));
+	  cg = _mm256_sub_epi8(cg, _mm256_cmpeq_epi8(v, vg));
+	  ct = _mm256_sub_epi8(ct, _mm256_cmpeq_epi8(v, vt));
+	}
+
+      sa = _mm256_add_epi64(sa, _mm256_sad_epu8(ca, zero));
+      sc = _mm256_add_epi64(sc, _mm256_sad_epu8(cc, zero));
+      sg = _mm256_add_epi64(sg, _mm256_sad_epu8(cg, zero));
+      st = _mm256_add_epi64(st, _mm256_sad_epu8(ct, zero));
+    }
+
+  u64 tail[4];
+
+  count_c(s + i, n - i, tail);
+
+#define HSUM(v) (_mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1) + \
+		 _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3))
+
+  cnt[BASE_A] = HSUM(sa) + tail[BASE_A];
+  cnt[BASE_C] = HSUM(sc) + tail[BASE_C];
+  cnt[BASE_G] = HSUM(sg) + tail[BASE_G];
+  cnt[BASE_T] = HSUM(st) + tail[BASE_T];
+
+#undef HSUM
+}
+
+//
+count_fn count_best()
+{
+  return __builtin_cpu_supports("avx2") ? count_avx2 : count_c;
+}
+
+//
+void *_count_(void *arg)
+{
+  count_thread_t *t = arg;
+
+  if (t->gc)
+    for (u64 b = t->b0; b < t->b1; b++)
+      {
+	u64 lo = b * t->step, c[4];
+
+	t->f(t->s + lo, (lo + t->step < t->n) ? t->step : t->n - lo, c);
+	t->gc[b] = c[BASE_C] + c[BASE_G];
+      }
+  else
+    t->f(t->s, t->n, t->cnt);
+
+  return NULL;
+}
+
+//Sequence split in nt ranges, counts summed
+void count_threads(u8 *s, u64 n, u64 *cnt, u64 nt)
+{
+  count_thread_t *t = malloc(nt * sizeof(count_thread_t));
+  u64 part = (n / nt) & ~31ULL;
+
+  if (!t)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].s = s + (i * part);
+      t[i].n = (i == nt - 1) ? n - (i * part) : part;
+      t[i].gc = NULL;
+      t[i].f = count_best();
+
+      pthread_create(&t[i].tid, NULL, _count_, &t[i]);
+    }
+
+  memset(cnt, 0, 4 * sizeof(u64));
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      pthread_join(t[i].tid, NULL);
+
+      for (int b = 0; b < 4; b++)
+	cnt[b] += t[i].cnt[b];
+    }
+
+  free(t);
+}
+
+//Sliding window GC profile: the G + C count of every step-sized block is
+//computed once (in parallel), a window of w = k * step bases is then the
+//running sum of k blocks. Writes "start gc_fraction" for each window.
+int gc_profile(u8 *s, u64 n, u64 w, u64 step, u64 nt, FILE *fp)
+{
+  u64 nb = (n + step - 1) / step, k = w / step;
+  u64 *gc = malloc(nb * sizeof(u64));
+  count_thread_t *t = malloc(nt * sizeof(count_thread_t));
+
+  if (!gc || !t)
+    return printf("Error: cannot allocate memory\n"), -1;
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].s = s;
+      t[i].n = n;
+      t[i].step = step;
+      t[i].b0 = (nb * i) / nt;
+      t[i].b1 = (nb * (i + 1)) / nt;
+      t[i].gc = gc;
+      t[i].f = count_best();
+
+      pthread_create(&t[i].tid, NULL, _count_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  u64 sum = 0;
+
+  for (u64 b = 0; b < nb; b++)
+    {
+      sum += gc[b];
+
+      if (b >= k)
+	sum -= gc[b - k];
+
+      //Only full windows
+      if (b + 1 >= k && (b + 1) * step <= n)
+	fprintf(fp, "%llu\t%.4lf\n", (b + 1 - k) * step, (double)sum / w);
+    }
+
+  free(gc);
+  free(t);
+
+  return 0;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+    return printf("Usage: %s count [seq] [threads]\n"
+		  "       %s profile [seq] [window] [step] [threads] [output]\n", argv[0], argv[0]), 1;
+
+  seq_t *s = load_seq_mmap(argv[2], 0);
+
+  if (!s)
+    error();
+
+  //Composition with every version
+  if (!strcmp(argv[1], "count"))
+    {
+      u64 nt = (argc > 3) ? atoll(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+      u64 ref[4], cnt[4];
+      double b, a;
+
+      if (!nt)
+	return printf("Error: number of threads must be > 0\n"), 2;
+
+      b = now(); count_c(s->bases, s->len, ref); a = now();
+
+      printf("count_c      : %.3lf GB/s\n", s->len / (a - b) / 1e9);
+
+      if (__builtin_cpu_supports("avx2"))
+	{
+	  b = now(); count_avx2(s->bases, s->len, cnt); a = now();
+
+	  printf("count_avx2   : %.3lf GB/s %s\n", s->len / (a - b) / 1e9, memcmp(cnt, ref, sizeof(ref)) ? "(MISMATCH)" : "");
+	}
+
+      b = now(); count_threads(s->bases, s->len, cnt, nt); a = now();
+
+      printf("count_threads: %.3lf GB/s (%llu threads) %s\n", s->len / (a - b) / 1e9, nt,
+	     memcmp(cnt, ref, sizeof(ref)) ? "(MISMATCH)" : "");
+
+      u64 total = ref[BASE_A] + ref[BASE_C] + ref[BASE_G] + ref[BASE_T];
+
+      printf("A: %llu, C: %llu, G: %llu, T: %llu, other: %llu, GC: %.4lf\n",
+	     ref[BASE_A], ref[BASE_C], ref[BASE_G], ref[BASE_T], s->len - total,
+	     total ? (double)(ref[BASE_C] + ref[BASE_G]) / total : 0.0);
+    }
+  else
+    if (!strcmp(argv[1], "profile"))
+      {
+	if (argc < 5)
+	  return printf("Error: profile needs a window and a step\n"), 1;
+
+	u64 w = atoll(argv[3]), step = atoll(argv[4]);
+	u64 nt = (argc > 5) ? atoll(argv[5]) : sysconf(_SC_NPROCESSORS_ONLN);
+	FILE *fp = (argc > 6) ? fopen(argv[6], "w") : stdout;
+
+	if (!step || !w || w % step)
+	  return printf("Error: window must be a non zero multiple of step\n"), 2;
+
+	if (!nt)
+	  return printf("Error: number of threads must be > 0\n"), 2;
+
+	if (!fp)
+	  return printf("Error: cannot create file '%s'\n", argv[6]), 2;
+
+	double b = now();
+
+	if (gc_profile(s->bases, s->len, w, step, nt, fp) < 0)
+	  return 3;
+
+	double a = now();
+
+	if (fp != stdout)
+	  {
+	    fclose(fp);
+	    printf("gc_profile   : %.3lf s, %.3lf GB/s\n", a - b, s->len / (a - b) / 1e9);
+	  }
+      }
+    else
+      return printf("Error: unknown mode '%s'\n", argv[1]), 1;
+
+  release_seq(s); free(s);
+
+  return 0;
+}
@@ -1,46 +1,264 @@
-//
+//Random DNA sequence generator
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "dna2.h"
+
+//Bases per chunk: chunk c always comes from the generator seeded with
+//(seed, c), so the output does not depend on the number of threads
+#define CHUNK (1ULL << 22)
+
+//
+typedef unsigned char      u8;
+typedef unsigned int       u32;
+typedef unsigned long long u64;
+
+//
+typedef struct {
+
+  //Output mapping, header size and total bases
+  u8 *map;
+  u64 hdr, len;
+
+  //Packed or text output
+  int packed;
+
+  //
+  u64 seed;
+
+  //Shared index of the next chunk
+  u64 *next;
+
+  //
+  pthread_t tid;
+
+} gen_thread_t;
+
+//xoshiro256** state
+typedef struct {
+
+  u64 s[4];
+
+} xoshiro_t;
+
+//4 text bases for every byte of random bits, base i of the byte in bits 2 * i
+u32 lut4[256];
 
 //
-unsigned randxy(unsigned x, unsigned y)
+static inline u64 rotl(u64 x, int k)
 {
-  return (x + (rand() % y)) % y; 
+  return (x << k) | (x >> (64 - k));
+}
+
+//Seeding generator, every call returns a well mixed 64-bit value
+static inline u64 splitmix64(u64 *x)
+{
+  u64 z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+//
+static inline u64 xoshiro_next(xoshiro_t *r)
+{
+  u64 *s = r->s;
+  u64 res = rotl(s[1] * 5, 7) * 9;
+  u64 t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return res;
+}
+
+//Independent stream for chunk c
+void xoshiro_seed(xoshiro_t *r, u64 seed, u64 c)
+{
+  u64 x = seed ^ (c * 0xd1b54a32d192ed03ULL);
+
+  for (int i = 0; i < 4; i++)
+    r->s[i] = splitmix64(&x);
+}
+
+//Every random word holds 32 bases, 2 bits each (codes of dna2.h). The packed
+//output is the words themselves, the text output expands each byte through
+//lut4, so both formats describe the same sequence for a given seed.
+void *_gen_(void *arg)
+{
+  gen_thread_t *t = arg;
+  u64 chunks = (t->len + CHUNK - 1) / CHUNK;
+
+  for (u64 c; (c = __sync_fetch_and_add(t->next, 1)) < chunks; )
+    {
+      xoshiro_t r;
+      u64 start = c * CHUNK;
+      u64 n = (t->len - start < CHUNK) ? t->len - start : CHUNK;
+      u64 i = 0;
+
+      xoshiro_seed(&r, t->seed, c);
+
+      if (t->packed)
+	{
+	  u8 *dst = t->map + t->hdr + (start >> 2);
+	  u64 bytes = (n + 3) >> 2;
+
+	  for (; i + 8 <= bytes; i += 8)
+	    {
+	      u64 w = xoshiro_next(&r);
+
+	      memcpy(dst + i, &w, 8);
+	    }
+
+	  if (i < bytes)
+	    {
+	      u64 w = xoshiro_next(&r);
+
+	      memcpy(dst + i, &w, bytes - i);
+	    }
+
+	  //Unused bits of the last byte are 0
+	  if (start + n == t->len && (n & 3))
+	    dst[bytes - 1] &= (1 << (2 * (n & 3))) - 1;
+	}
+      else
+	{
+	  u8 *dst = t->map + t->hdr + start;
+
+	  for (; i + 32 <= n; i += 32)
+	    {
+	      u64 w = xoshiro_next(&r);
+
+	      for (int b = 0; b < 8; b++)
+		memcpy(dst + i + (4 * b), &lut4[(w >> (8 * b)) & 0xff], 4);
+	    }
+
+	  if (i < n)
+	    {
+	      u64 w = xoshiro_next(&r);
+
+	      for (u64 j = 0; i + j < n; j++)
+		dst[i + j] = DNA2_BASES[(w >> (2 * j)) & 3];
+	    }
+	}
+    }
+
+  return NULL;
+}
+
+//
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 //
 int main(int argc, char **argv)
 {
   //
-  srand(getpid());
-  
-  //
-  if (argc < 2)
-    return printf("Usage: %s [output file] [length]\n", argv[0]), 1;
+  if (argc < 3)
+    return printf("Usage: %s [output file] [length] [text|packed] [threads] [seed]\n", argv[0]), 1;
 
   //
-  unsigned long long len = atoll(argv[2]);
-  
+  u64 len = atoll(argv[2]);
+  int packed = (argc > 3 && !strcmp(argv[3], "packed"));
+  u64 nt = (argc > 4) ? atoll(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  //Without a seed every run gives a different sequence
+  u64 seed = (argc > 5) ? strtoull(argv[5], NULL, 0) : (u64)getpid() ^ ((u64)time(NULL) << 20);
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
   //
-  const char bases[4] = "ATCG"; 
-  
+  for (u32 b = 0; b < 256; b++)
+    {
+      u8 c[4];
+
+      for (int i = 0; i < 4; i++)
+	c[i] = DNA2_BASES[(b >> (2 * i)) & 3];
+
+      memcpy(&lut4[b], c, 4);
+    }
+
+  //Packed: header then 4 bases per byte. Text: bases then a newline at EOF.
+  u64 hdr = packed ? DNA2_HDR : 0;
+  u64 size = packed ? hdr + ((len + 3) >> 2) : len + 1;
+
+  //Output is mapped and filled in place by the threads
+  int fd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    return printf("Error: cannot create file '%s'\n", argv[1]), 2;
+
+  if (ftruncate(fd, size) < 0)
+    return printf("Error: cannot resize file '%s'\n", argv[1]), 2;
+
+  u8 *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED)
+    return printf("Error: cannot map file '%s'\n", argv[1]), 2;
+
+  if (packed)
+    {
+      memcpy(map, DNA2_MAGIC, 8);
+
+      for (int i = 0; i < 8; i++)
+	map[8 + i] = (len >> (8 * i)) & 0xff;
+    }
+  else
+    map[len] = '\n';
+
   //
-  FILE *fp = fopen(argv[1], "wb");
+  gen_thread_t *t = malloc(nt * sizeof(gen_thread_t));
+  u64 next = 0;
+
+  if (!t)
+    return printf("Error: cannot allocate memory\n"), 3;
+
+  double b = now();
 
-  if (!fp)
-    return printf("Error: cannot create file '%s'\n", argv[2]), 2;
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].map = map;
+      t[i].hdr = hdr;
+      t[i].len = len;
+      t[i].packed = packed;
+      t[i].seed = seed;
+      t[i].next = &next;
 
-  //Generate random DNA sequence
-  for (unsigned long long i = 0; i < len; i++)
-    fprintf(fp, "%c", bases[randxy(0, 4)]);
+      pthread_create(&t[i].tid, NULL, _gen_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  double a = now();
 
-  //Newline at EOF
-  fprintf(fp, "\n");
-  
   //
-  fclose(fp);
-    
+  munmap(map, size);
+  close(fd);
+  free(t);
+
+  printf("%llu bases (%s, seed 0x%llx), %llu threads: %.3lf s, %.1lf Mbases/s\n",
+	 len, packed ? "packed" : "text", seed, nt, a - b, len / (a - b) / 1e6);
+
   //
   return 0;
 }
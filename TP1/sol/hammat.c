@@ -0,0 +1,392 @@
+//All-vs-all Hamming distance matrix over a collection of equal length sequences
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "seq.h"
+#include "hamming.h"
+
+//Rows are padded with zeros to a multiple of 64 bytes, the padding never counts
+#define SET_ALIGN 64
+
+//Two tiles of rows should fit in L2: every row of tile I is compared to
+//every row of tile J while both stay cached
+#define TILE_BYTES (256 << 10)
+
+//
+typedef unsigned int u32;
+
+//Sequence collection, stored as n rows of stride bytes
+typedef struct {
+
+  u8 *data;
+
+  //Number of sequences, bases per sequence, bytes per row
+  u64 n, len, stride;
+
+  //Allocated rows
+  u64 cap;
+
+} seqset_t;
+
+//
+typedef struct {
+
+  //Input and output
+  seqset_t *set;
+  u32 *d;
+
+  //Tile pairs (I <= J) and the shared index of the next one to compute
+  u64 tile, npairs;
+  u64 (*pairs)[2];
+  u64 *next;
+
+  //
+  pthread_t tid;
+
+} hammat_thread_t;
+
+//Appends one sequence, all of them must have the same length
+int seqset_add(seqset_t *set, u8 *bases, u64 len)
+{
+  //Trailing newline is not part of the sequence
+  while (len && (bases[len - 1] == '\n' || bases[len - 1] == '\r'))
+    len--;
+
+  if (!len)
+    return 0;
+
+  if (!set->n)
+    {
+      set->len = len;
+      set->stride = (len + SET_ALIGN - 1) & ~(u64)(SET_ALIGN - 1);
+    }
+  else
+    if (len != set->len)
+      return printf("Error: sequence %llu has %llu bases, expected %llu\n", set->n, len, set->len), -1;
+
+  if (set->n == set->cap)
+    {
+      u64 cap = set->cap ? 2 * set->cap : 64;
+      u8 *data = realloc(set->data, cap * set->stride);
+
+      if (!data)
+	return printf("Error: cannot allocate memory\n"), -1;
+
+      set->data = data;
+      set->cap = cap;
+    }
+
+  u8 *row = set->data + (set->n * set->stride);
+
+  memcpy(row, bases, len);
+  memset(row + len, 0, set->stride - len);
+
+  set->n++;
+
+  return 0;
+}
+
+//
+static int cmp_names(const void *a, const void *b)
+{
+  return strcmp(*(char **)a, *(char **)b);
+}
+
+//One sequence per file, in file name order
+int seqset_load_dir(seqset_t *set, const char *path)
+{
+  DIR *dir = opendir(path);
+  char **names = NULL;
+  u64 count = 0, cap = 0;
+  struct dirent *e;
+  int ret = 0;
+
+  if (!dir)
+    return printf("Error: cannot open directory '%s'\n", path), -1;
+
+  while ((e = readdir(dir)))
+    {
+      if (e->d_name[0] == '.')
+	continue;
+
+      if (count == cap)
+	{
+	  char **tmp = realloc(names, (cap ? 2 * cap : 256) * sizeof(char *));
+
+	  if (!tmp)
+	    {
+	      for (u64 i = 0; i < count; i++)
+		free(names[i]);
+
+	      free(names);
+	      closedir(dir);
+
+	      return printf("Error: cannot allocate memory\n"), -1;
+	    }
+
+	  names = tmp;
+	  cap = cap ? 2 * cap : 256;
+	}
+
+      names[count] = malloc(strlen(path) + strlen(e->d_name) + 2);
+      sprintf(names[count++], "%s/%s", path, e->d_name);
+    }
+
+  closedir(dir);
+
+  qsort(names, count, sizeof(char *), cmp_names);
+
+  for (u64 i = 0; i < count && !ret; i++)
+    {
+      seq_t *s = load_seq_mmap(names[i], 0);
+
+      if (s)
+	{
+	  ret = seqset_add(set, s->bases, s->len);
+	  release_seq(s); free(s);
+	}
+      else
+	{
+	  printf("Error: cannot load '%s'\n", names[i]);
+	  ret = -1;
+	}
+    }
+
+  for (u64 i = 0; i < count; i++)
+    free(names[i]);
+
+  free(names);
+
+  return ret;
+}
+
+//Multi-record file: FASTA ('>' header lines, sequence lines concatenated)
+//or plain text with one sequence per line
+int seqset_load_file(seqset_t *set, const char *path)
+{
+  seq_t *s = load_seq_mmap(path, 0);
+
+  if (!s)
+    error();
+
+  u8 *p = s->bases, *end = s->bases + s->len;
+  int ret = 0;
+
+  if (s->len && p[0] == '>')
+    {
+      u8 *rec = malloc(s->len);
+      u64 n = 0;
+
+      if (!rec)
+	{
+	  release_seq(s); free(s);
+
+	  return printf("Error: cannot allocate memory\n"), -1;
+	}
+
+      while (p < end && !ret)
+	{
+	  u8 *eol = memchr(p, '\n', end - p);
+
+	  if (!eol)
+	    eol = end;
+
+	  if (*p == '>')
+	    {
+	      ret = seqset_add(set, rec, n);
+	      n = 0;
+	    }
+	  else
+	    {
+	      //CRLF lines: the '\r' is not a base
+	      u64 l = ((eol > p) && (eol[-1] == '\r')) ? eol - p - 1 : eol - p;
+
+	      memcpy(rec + n, p, l);
+	      n += l;
+	    }
+
+	  p = eol + 1;
+	}
+
+      if (!ret)
+	ret = seqset_add(set, rec, n);
+
+      free(rec);
+    }
+  else
+    while (p < end && !ret)
+      {
+	u8 *eol = memchr(p, '\n', end - p);
+
+	if (!eol)
+	  eol = end;
+
+	ret = seqset_add(set, p, eol - p);
+	p = eol + 1;
+      }
+
+  release_seq(s); free(s);
+
+  return ret;
+}
+
+//Worker: grabs tile pairs until there are none left
+void *_hammat_(void *arg)
+{
+  hammat_thread_t *t = arg;
+  seqset_t *set = t->set;
+  u64 n = set->n;
+
+  for (u64 p; (p = __sync_fetch_and_add(t->next, 1)) < t->npairs; )
+    {
+      u64 i0 = t->pairs[p][0] * t->tile, i1 = (i0 + t->tile < n) ? i0 + t->tile : n;
+      u64 j0 = t->pairs[p][1] * t->tile, j1 = (j0 + t->tile < n) ? j0 + t->tile : n;
+
+      for (u64 i = i0; i < i1; i++)
+	{
+	  u8 *a = set->data + (i * set->stride);
+
+	  //Diagonal tiles only do the upper half
+	  for (u64 j = (i0 == j0) ? i + 1 : j0; j < j1; j++)
+	    {
+	      u32 h = hamming(a, set->data + (j * set->stride), set->stride);
+
+	      t->d[(i * n) + j] = h;
+	      t->d[(j * n) + i] = h;
+	    }
+	}
+    }
+
+  return NULL;
+}
+
+//Fills the n x n matrix d using nt threads
+void hammat(seqset_t *set, u32 *d, u64 nt)
+{
+  u64 tile = TILE_BYTES / (2 * set->stride);
+
+  if (!tile)
+    tile = 1;
+
+  u64 nb = (set->n + tile - 1) / tile;
+  u64 npairs = nb * (nb + 1) / 2, next = 0, p = 0;
+  u64 (*pairs)[2] = malloc(npairs * sizeof(*pairs));
+  hammat_thread_t *t = malloc(nt * sizeof(hammat_thread_t));
+
+  if (!pairs || !t)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nb; i++)
+    for (u64 j = i; j < nb; j++)
+      {
+	pairs[p][0] = i;
+	pairs[p++][1] = j;
+      }
+
+  memset(d, 0, set->n * set->n * sizeof(u32));
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].set = set;
+      t[i].d = d;
+      t[i].tile = tile;
+      t[i].npairs = npairs;
+      t[i].pairs = pairs;
+      t[i].next = &next;
+
+      pthread_create(&t[i].tid, NULL, _hammat_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  free(pairs);
+  free(t);
+}
+
+//Binary output: n and len as 64-bit integers, then n * n 32-bit distances row by row
+int write_hammat(const char *fname, seqset_t *set, u32 *d)
+{
+  FILE *fp = fopen(fname, "wb");
+
+  if (!fp)
+    return printf("Error: cannot create file '%s'\n", fname), -1;
+
+  u64 hdr[2] = { set->n, set->len };
+
+  fwrite(hdr, sizeof(u64), 2, fp);
+
+  if (fwrite(d, sizeof(u32), set->n * set->n, fp) != set->n * set->n)
+    return fclose(fp), printf("Error: cannot write '%s'\n", fname), -1;
+
+  fclose(fp);
+
+  return 0;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+    return printf("Usage: %s [input directory or file] [output matrix] [threads]\n", argv[0]), 1;
+
+  u64 nt = (argc > 3) ? atoll(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+  seqset_t set = { 0 };
+  struct stat sb;
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
+  if (stat(argv[1], &sb) < 0)
+    return printf("Error: cannot 'stat' '%s'\n", argv[1]), 2;
+
+  if ((S_ISDIR(sb.st_mode) ? seqset_load_dir(&set, argv[1]) : seqset_load_file(&set, argv[1])) < 0)
+    return 3;
+
+  if (set.n < 2)
+    return printf("Error: need at least 2 sequences\n"), 3;
+
+  //A distance is at most 8 bits per byte
+  if (set.len > 0xffffffffULL / 8)
+    return printf("Error: sequences too long for 32-bit distances\n"), 3;
+
+  u32 *d = malloc(set.n * set.n * sizeof(u32));
+
+  if (!d)
+    return printf("Error: cannot allocate %llu x %llu matrix\n", set.n, set.n), 4;
+
+  hamming_init();
+
+  double b = now();
+  hammat(&set, d, nt);
+  double a = now();
+
+  //Spot check against the reference kernel
+  u64 bad = 0;
+
+  srand(0);
+
+  for (u64 k = 0; k < 1000; k++)
+    {
+      u64 i = rand() % set.n, j = rand() % set.n;
+
+      bad += (d[(i * set.n) + j] != hamming_c(set.data + (i * set.stride), set.data + (j * set.stride), set.len));
+    }
+
+  u64 pairs = set.n * (set.n - 1) / 2;
+
+  printf("%llu sequences of %llu bases, %llu threads: %.3lf s, %.3lf Mpairs/s, %.3lf GB/s %s\n",
+	 set.n, set.len, nt, a - b, pairs / (a - b) / 1e6, 2.0 * pairs * set.len / (a - b) / 1e9,
+	 bad ? "(MISMATCH)" : "");
+
+  if (write_hammat(argv[2], &set, d) < 0)
+    return 5;
+
+  free(d);
+  free(set.data);
+
+  return 0;
+}
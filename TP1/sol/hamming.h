@@ -0,0 +1,320 @@
+#pragma once
+
+//Hamming distance kernels, hamming() picks the fastest one for this CPU
+#include <string.h>
+#include <immintrin.h>
+
+#include "seq.h"
+
+//接受两个字节数组指针 a 和 b，以及一个无符号64位整数 n，表示要比较的字节数目。函数返回一个无符号64位整数，表示汉明距离。
+u64 hamming_c(u8 *a, u8 *b, u64 n)
+{
+  //声明并初始化一个无符号64位整数 h 为0，用于存储汉明距离的计数。
+  u64 h = 0;
+
+  //使用 for 循环遍历 a 和 b 数组中的每个字节，i 从0递增到 n-1。
+  //在循环中，对每对相同位置上的字节执行以下操作：
+  for (u64 i = 0; i < n; i++)
+    h += __builtin_popcount(a[i] ^ b[i]); 
+  //a[i] ^ b[i] 计算 a 和 b 在相同位置上的字节的异或结果，这将标识出不同字节的位。
+  //__builtin_popcount 是一个内置函数，它用于计算整数中设置为1的位的数量，这里用于计算不同字节的位数。
+  //将结果添加到 h 中，以累积汉明距离
+
+  //返回计算得到的汉明距离，即两个字节数组之间的不同字节的位数之和。
+  return h;
+} //这个函数使用循环遍历两个数组中的每个字节，计算它们之间的不同位数，最终返回汉明距离。
+  //这是一种常用的方法来衡量两个二进制序列之间的差异。
+
+//这段代码实现了一个名为 hamming_asm_8bits 的汉明距离计算函数，使用汇编语言来执行
+//这是函数的声明，接受两个字节数组指针 a 和 b，以及一个无符号64位整数 n，表示要比较的字节数目。
+//函数返回一个无符号64位整数，表示汉明距离。
+u64 hamming_asm_8bits(u8 *a, u8 *b, u64 n)
+{
+  //在函数开始时，声明并初始化一个无符号64位整数 h 为0，用于存储汉明距离的计数。
+  u64 h = 0;
+
+  //Size in bytes
+  //将 sizeb 初始化为 n，表示要比较的字节数目。
+  u64 sizeb = n;
+  
+  //汇编代码块：在这个块中，使用汇编语言来执行汉明距离的计算。这个块包括一系列汇编指令，用于循环遍历字节数组 a 和 b 并计算汉明距离。
+  __asm__ volatile (
+        //xor 指令用于清零寄存器
+		    "xor %%rax, %%rax;\n"  
+		    "xor %%rbx, %%rbx;\n"
+		    "xor %%rcx, %%rcx;\n"
+		    "xor %%rdx, %%rdx;\n"
+
+        //1:; 是一个标签，用于表示循环的入口点
+		    "1:;\n" 
+
+		    //Loading bytes   
+        //movb 指令用于加载字节值     
+		    "movb (%[_a], %%rcx), %%al;\n" 
+		    "movb (%[_b], %%rcx), %%bl;\n"
+
+		    //Xoring bytes    
+        //xor 指令用于执行异或操作
+		    "xor %%bl, %%al;\n"
+
+		    //Popcount on 16bits (no 8 bits popcount on x86)     
+        //popcnt 指令用于计算汉明距离的16位部分
+		    "popcnt %%ax, %%bx;\n"
+		    
+        //add 指令用于累积汉明距离
+		    "add %%rbx, %%rdx;\n"  
+		    
+        //add 指令用于递增循环计数器
+		    "add $1, %%rcx;\n"   
+        //add 指令用于递增循环计数器  
+		    "cmp %[_sizeb], %%rcx;\n"   
+        //jl 指令用于条件跳转，如果计数器小于 sizeb，则继续循环
+		    "jl 1b;\n"          
+		    
+        //将计算得到的汉明距离存储在寄存器 rdx 中的值传递给输出变量 h
+		    "mov %%rdx, %[_h];\n"    
+		    
+		    : //outputs 
+		      [_h] "=r" (h)
+		      
+		    : //inputs
+		      [_a]     "r" (a),
+		      [_b]     "r" (b),
+		      [_sizeb] "r" (sizeb)
+		      
+		    :
+		    "cc", "memory", "rax", "rbx", "rcx", "rdx");
+  
+  //返回计算得到的汉明距离 h
+  return h;
+} //这个函数使用汇编语言来执行汉明距离的计算，通过循环遍历字节数组 a 和 b 中的每个字节，执行异或和汉明距离计算操作，
+  //最终返回汉明距离。这种方法可以在汇编级别更有效地执行计算。
+
+//这个版本处理64位块而不是字节，从而提高了效率
+u64 hamming_asm_64bits(u8 *a, u8 *b, u64 n)
+{
+  //
+  u64 h = 0;
+
+  //Size in bytes
+  u64 sizeb = n;
+  
+  //
+  __asm__ volatile (
+		    "xor %%rcx, %%rcx;\n"
+		    "xor %%rdx, %%rdx;\n"
+
+		    "1:;\n"
+
+		    //Loading 64bit blocks rather than bytes
+        //movq 指令用于加载64位块的值
+		    "movq (%[_a], %%rcx), %%rax;\n" 
+		    "movq (%[_b], %%rcx), %%rbx;\n"
+
+		    //
+		    "xor %%rbx, %%rax;\n"
+		    "popcnt %%rax, %%rbx;\n"
+
+		    "add %%rbx, %%rdx;\n"
+		    
+		    "add $8, %%rcx;\n"
+		    "cmp %[_sizeb], %%rcx;\n"
+		    "jl 1b;\n"
+
+		    "mov %%rdx, %[_h];\n"
+		    
+		    : //outputs
+		      [_h] "=r" (h)
+		      
+		    : //inputs
+		      [_a]     "r" (a),
+		      [_b]     "r" (b),
+		      [_sizeb] "r" (sizeb)
+		      
+		    :
+		    "cc", "memory", "rax", "rbx", "rcx", "rdx");
+  
+  //
+  return h;
+} //这个版本的函数相比前一个版本处理的数据块更大，因此在处理大量数据时可能会更快。
+  //它的原理与前一个版本类似，只是每次处理64位块而不是单个字节。这种方法可以在汇编级别更有效地执行计算。
+
+//Scalar tail: 64-bit popcount on whole words, then the remaining bytes
+static inline u64 hamming_tail(u8 *a, u8 *b, u64 n)
+{
+  u64 h = 0, i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      u64 x, y;
+
+      memcpy(&x, a + i, 8);
+      memcpy(&y, b + i, 8);
+      
+      h += __builtin_popcountll(x ^ y);
+    }
+  
+  for (; i < n; i++)
+    h += __builtin_popcount(a[i] ^ b[i]);
+
+  return h;
+}
+
+//Per byte popcount of a vector: the low and high nibbles index a 16 entry
+//table through vpshufb
+__attribute__((target("avx2")))
+static inline __m256i popcnt8_avx2(__m256i v)
+{
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+				       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  
+  __m256i lo = _mm256_and_si256(v, low);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+
+  return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+}
+
+//Sum of the 4 64-bit lanes
+__attribute__((target("avx2")))
+static inline u64 hsum_epu64(__m256i v)
+{
+  __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+  return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+}
+
+//AVX2 nibble LUT: byte counts are accumulated for up to 31 vectors (31 * 8
+//fits a byte) before being folded into 64-bit lanes with vpsadbw
+__attribute__((target("avx2")))
+u64 hamming_avx2_lut(u8 *a, u8 *b, u64 n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  u64 i = 0;
+
+  while (i + 32 <= n)
+    {
+      __m256i cnt = _mm256_setzero_si256();
+
+      for (u64 j = 0; j < 31 && i + 32 <= n; j++, i += 32)
+	{
+	  __m256i x = _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(a + i)),
+				       _mm256_loadu_si256((__m256i *)(b + i)));
+
+	  cnt = _mm256_add_epi8(cnt, popcnt8_avx2(x));
+	}
+      
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+  
+  return hsum_epu64(acc) + hamming_tail(a + i, b + i, n - i);
+}
+
+//Carry-save adder: h:l = a + b + c bitwise
+#define CSA(h, l, a, b, c)						\
+  do									\
+    {									\
+      __m256i _u = _mm256_xor_si256((a), (b));				\
+									\
+      h = _mm256_or_si256(_mm256_and_si256((a), (b)), _mm256_and_si256(_u, (c))); \
+      l = _mm256_xor_si256(_u, (c));					\
+    }									\
+  while (0)
+
+//AVX2 Harley-Seal: 16 vectors at a time go through a tree of carry-save
+//adders so only one popcount per 16 vectors is needed for the sixteens,
+//the ones/twos/fours/eights are counted once at the end
+__attribute__((target("avx2")))
+u64 hamming_avx2_hs(u8 *a, u8 *b, u64 n)
+{
+  __m256i total = _mm256_setzero_si256();
+  __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256();
+  __m256i fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256();
+  __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+  u64 i = 0;
+
+#define LDX(k) _mm256_xor_si256(_mm256_loadu_si256((__m256i *)(a + i + (k) * 32)), \
+				_mm256_loadu_si256((__m256i *)(b + i + (k) * 32)))
+  
+  for (; i + 512 <= n; i += 512)
+    {
+      CSA(twos_a, ones, ones, LDX(0), LDX(1));
+      CSA(twos_b, ones, ones, LDX(2), LDX(3));
+      CSA(fours_a, twos, twos, twos_a, twos_b);
+      CSA(twos_a, ones, ones, LDX(4), LDX(5));
+      CSA(twos_b, ones, ones, LDX(6), LDX(7));
+      CSA(fours_b, twos, twos, twos_a, twos_b);
+      CSA(eights_a, fours, fours, fours_a, fours_b);
+      CSA(twos_a, ones, ones, LDX(8), LDX(9));
+      CSA(twos_b, ones, ones, LDX(10), LDX(11));
+      CSA(fours_a, twos, twos, twos_a, twos_b);
+      CSA(twos_a, ones, ones, LDX(12), LDX(13));
+      CSA(twos_b, ones, ones, LDX(14), LDX(15));
+      CSA(fours_b, twos, twos, twos_a, twos_b);
+      CSA(eights_b, fours, fours, fours_a, fours_b);
+      CSA(sixteens, eights, eights, eights_a, eights_b);
+
+      total = _mm256_add_epi64(total, _mm256_sad_epu8(popcnt8_avx2(sixteens), _mm256_setzero_si256()));
+    }
+
+#undef LDX
+
+  total = _mm256_slli_epi64(total, 4);
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(_mm256_sad_epu8(popcnt8_avx2(eights), _mm256_setzero_si256()), 3));
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(_mm256_sad_epu8(popcnt8_avx2(fours), _mm256_setzero_si256()), 2));
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(_mm256_sad_epu8(popcnt8_avx2(twos), _mm256_setzero_si256()), 1));
+  total = _mm256_add_epi64(total, _mm256_sad_epu8(popcnt8_avx2(ones), _mm256_setzero_si256()));
+  
+  return hsum_epu64(total) + hamming_avx2_lut(a + i, b + i, n - i);
+}
+
+#undef CSA
+
+//AVX-512 vpopcntq on 64 bytes at a time, the tail goes through a masked load
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+u64 hamming_avx512(u8 *a, u8 *b, u64 n)
+{
+  __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+  u64 i = 0;
+
+  for (; i + 128 <= n; i += 128)
+    {
+      __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+      __m512i x1 = _mm512_xor_si512(_mm512_loadu_si512(a + i + 64), _mm512_loadu_si512(b + i + 64));
+
+      acc0 = _mm512_add_epi64(acc0, _mm512_popcnt_epi64(x0));
+      acc1 = _mm512_add_epi64(acc1, _mm512_popcnt_epi64(x1));
+    }
+
+  for (; i < n; i += 64)
+    {
+      __mmask64 m = (n - i >= 64) ? ~0ULL : (1ULL << (n - i)) - 1;
+      __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, a + i), _mm512_maskz_loadu_epi8(m, b + i));
+
+      acc0 = _mm512_add_epi64(acc0, _mm512_popcnt_epi64(x));
+    }
+  
+  return _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+//Best kernel for this CPU, set by hamming_init()
+u64 (*hamming_best)(u8 *, u8 *, u64) = hamming_tail;
+
+//
+void hamming_init()
+{
+  if (__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("avx512bw"))
+    hamming_best = hamming_avx512;
+  else
+    if (__builtin_cpu_supports("avx2"))
+      hamming_best = hamming_avx2_hs;
+}
+
+//Harley-Seal only pays off once there are full 512 byte blocks
+u64 hamming(u8 *a, u8 *b, u64 n)
+{
+  if (hamming_best == hamming_avx2_hs && n < 512)
+    return hamming_avx2_lut(a, b, n);
+  
+  return hamming_best(a, b, n);
+}
@@ -0,0 +1,434 @@
+#pragma once
+
+//PPM (P6) images: loading, mapping and writing, shared by the image programs
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+//
+typedef unsigned char      u8;
+typedef unsigned long long u64;
+
+//这是一个结构体定义，表示 PPM (Portable Pixmap) 格式图像的信息。PPM 是一种无损的位图图像格式，通常用于存储彩色或灰度图像。
+typedef struct {
+
+  //分别表示图像的宽度和高度，以无符号64位整数 (u64) 存储。这些值确定了图像的像素尺寸。
+  u64 w;
+  u64 h;
+
+  //表示图像的颜色深度或类型。通常，PPM 图像的颜色深度为 8 位（灰度图像）或 24 位（彩色图像）。
+  //这里使用 u64 存储，可能用于表示其他颜色深度。
+  //transparence included (32 not enough)
+  u64 t;
+  
+  //一个指向图像像素数据的指针。像素数据通常以一维数组的形式存储，每个像素包含一个或多个颜色通道的值。
+  //u8 表示无符号8位整数，通常用于表示像素的颜色通道值。
+  u8 *pixels;
+
+  //File mapping holding the header and the pixels, NULL for heap images
+  u8 *map;
+  u64 size;
+
+} ppm_t;
+
+//Loads a PPM file with pixels stored in binary format P6
+//Netpbm format details can be found here: https://en.wikipedia.org/wiki/Netpbm#Description
+//加载 PPM 图像文件并创建一个 ppm_t 结构
+ppm_t *load_ppm(const char *fname)
+{
+  //检查文件名是否为 NULL，如果为 NULL，将打印错误消息并返回 NULL
+  if (!fname)
+    return printf("Error: file name is NULL"), NULL;
+
+  //
+  u64 w = 0;
+  u64 h = 0;
+  u64 t = 0;
+  
+  //打开指定文件，如果文件无法打开，也将打印错误消息并返回 NULL
+  FILE *fp = fopen(fname, "rb");
+
+  if (!fp)
+    return printf("Error: cannot open file '%s'\n", fname), NULL;
+
+  //Create PPM holder
+  //创建一个 ppm_t 结构体指针 p 并分配内存以存储图像数据，如果内存分配失败，同样会打印错误消息并返回 NULL
+  ppm_t *p = malloc(sizeof(ppm_t));
+  
+  if (!p)
+    return printf("Error: cannot allocate memory for ppm file\n"), NULL;
+
+  //读取 PPM 图像文件的标识符，通常为 "P6"，如果标识符不匹配，将打印错误消息并返回 NULL。
+  u8 id1 = 0, id2 = 0;
+  
+  fscanf(fp, "%c%c\n", &id1, &id2);
+
+  if (id1 != 'P' || id2 != '6')
+    return printf("Error: only PPM P6 binary format is handled\n"), NULL;
+  
+  //Read width and height of the image
+  //读取图像的宽度和高度，并将它们存储在 w 和 h 变量中。
+  fscanf(fp, "%llu %llu\n", &w, &h);
+
+  //Reading threshold
+  //读取颜色深度或阈值，并将其存储在 t 变量中。
+  fscanf(fp, "%llu\n", &t);
+  
+  //将图像的宽度、高度和颜色深度存储在 ppm_t 结构体的相应成员中。
+  p->w = w;
+  p->h = h;
+  p->t = t;
+  p->map = NULL;
+  
+  //Pixels are stored in RGB (3 bytes), hence the w * h * 3.
+  //分配足够的内存来存储图像的像素数据，每个像素由 RGB 三个通道组成，因此需要分配 w * h * 3 字节的内存。
+  p->pixels = malloc(sizeof(u8) * w * h * 3);
+
+  if (!p->pixels)
+    return printf("Error: cannot allocate memory for pixels\n"), NULL;
+
+  //使用 fread 函数从文件中读取像素数据，并将其存储在 p->pixels 中。
+  size_t read_bytes = fread(p->pixels, sizeof(u8), w * h * 3, fp);
+
+  //关闭文件
+  fclose(fp);
+  
+  //检查读取的字节数是否与图像分辨率相匹配，如果不匹配，将打印错误消息并返回 NULL
+  if (read_bytes != (w * h * 3))
+    return printf("Error: mismatch between read bytes and image resolution\n"), NULL;
+  
+  //返回指向 ppm_t 结构的指针，该结构包含了图像的信息和像素数据
+  return p;
+} //这个函数用于加载 PPM 图像文件，将图像信息存储在 ppm_t 结构中，并返回指向该结构的指针。
+  //如果加载失败，它会返回 NULL 并打印相关错误消息。
+
+//
+ppm_t *create_ppm(u64 w, u64 h, u64 t)
+{
+  //分配内存以容纳ppm_t结构，并检查内存分配是否成功。
+  ppm_t *p = malloc(sizeof(ppm_t));
+
+  if (!p)
+    return printf("Error: cannot allocate memory for ppm\n"), NULL;
+  
+  //设置图像的宽度、高度和色深。
+  p->w = w;
+  p->h = h;
+  p->t = t;
+  p->map = NULL;
+  
+  //分配内存以容纳像素数据，并检查内存分配是否成功。
+  p->pixels = malloc(sizeof(u8) * w * h * 3);
+
+  if (!p->pixels)
+    return printf("Error: cannot allocate memory for pixels\n"), NULL;
+
+  //First touch through initialization
+  //使用memset函数将像素数据初始化为零
+  memset(p->pixels, 0, w * h *3);
+  
+  //
+  return p;
+} //这个函数的目的是创建一个空白的PPM图像，可以在后续的图像处理中填充像素数据。
+  //在填充像素数据后，不要忘记使用release_ppm函数来释放内存，以防止内存泄漏。
+
+//这是一个用于将PPM格式图像写入文件的函数。它接受两个参数，一个是指向ppm_t结构的指针（表示要写入的图像），
+//另一个是要写入的文件的文件名。该函数将图像数据以二进制格式写入指定的文件中。
+void write_ppm(ppm_t *p, const char *fname)
+{
+  //检查传递给函数的指针是否为NULL，以确保图像和文件名都有效。
+  if (!p || !fname)
+    printf("Error: pointer is NULL"), exit(-1);
+
+  //打开指定文件以供写入，如果文件无法打开，则报告错误并退出。
+  FILE *fp = fopen(fname, "wb");
+
+  if (!fp)
+    printf("Error: cannot create file '%s'\n", fname), exit(-1);
+
+  //Writing format identifier
+  //写入PPM文件的格式标识符（通常为 "P6"，表示二进制PPM格式）。
+  fprintf(fp, "P6\n");
+  
+  //Writing image dimensions
+  //写入图像的宽度和高度。
+  fprintf(fp, "%llu %llu\n", p->w, p->h);
+
+  //写入色深信息。
+  fprintf(fp, "%llu\n", p->t);
+  
+  //Writing pixels in binary format
+  //以二进制格式写入图像的像素数据。
+  fwrite(p->pixels, sizeof(u8), p->w * p->h * 3, fp);
+
+  //关闭文件。
+  fclose(fp);
+} //此函数用于将图像数据保存到PPM格式文件中，以便后续可以加载和显示。
+ 
+//release_ppm 函数用于释放 ppm_t 结构和其包含的像素数据内存。函数的主要任务是确保释放所有分配的内存，以免发生内存泄漏。
+void release_ppm(ppm_t *p)
+{  //函数检查传递给它的 ppm_t 结构指针 p 是否为 NULL，以确保它不会试图释放空指针。
+  if (p) 
+    { //如果 p 不为空，函数继续执行。它进一步检查 p 中的 pixels 成员是否为空。
+      //如果 pixels 不为空，它释放了该内存，以释放图像像素数据。
+      if (p->map)
+	munmap(p->map, p->size);
+      else
+	if (p->pixels) 
+	  free(p->pixels);
+
+      p->map = NULL;
+      p->pixels = NULL;
+
+      p->w = 0; //函数将 w 和 h 成员都设置为0，以指示 ppm_t 结构不再引用有效的图像数据。
+      p->h = 0;
+    }
+  else
+    { //如果 p 为空（即传递给函数的指针为空），函数将报告错误并终止程序。
+      printf("Error: pointer is NULL\n");
+      exit(-1); 
+    } //这个函数的主要目的是确保在不再需要 ppm_t 结构时释放相关的内存，以免内存泄漏。
+}
+
+//Parses a P6 header held in memory (comments allowed), returns the offset
+//of the pixels or 0 when the header is invalid
+static inline u64 parse_ppm_header(u8 *b, u64 size, u64 *w, u64 *h, u64 *t)
+{
+  u64 v[3] = { 0 }, i = 2;
+
+  if (size < 2 || b[0] != 'P' || b[1] != '6')
+    return 0;
+
+  for (int k = 0; k < 3; k++)
+    {
+      //Whitespace and comments
+      while (i < size && (b[i] == ' ' || b[i] == '\t' || b[i] == '\n' || b[i] == '\r' || b[i] == '#'))
+	if (b[i] == '#')
+	  while (i < size && b[i] != '\n')
+	    i++;
+	else
+	  i++;
+
+      if (i == size || b[i] < '0' || b[i] > '9')
+	return 0;
+
+      while (i < size && b[i] >= '0' && b[i] <= '9')
+	v[k] = (v[k] * 10) + (b[i++] - '0');
+    }
+
+  //A single whitespace character before the pixels
+  if (i == size)
+    return 0;
+
+  *w = v[0];
+  *h = v[1];
+  *t = v[2];
+
+  return i + 1;
+}
+
+//Zero-copy loader: the file is mapped private and the pixels are used where
+//they are. Writes go to copy-on-write pages, so in-place transforms never
+//modify the input file.
+ppm_t *map_ppm(const char *fname)
+{
+  if (!fname)
+    return printf("Error: file name is NULL"), NULL;
+
+  int fd = open(fname, O_RDONLY);
+
+  if (fd < 0)
+    return printf("Error: cannot open file '%s'\n", fname), NULL;
+
+  struct stat sb;
+
+  if (fstat(fd, &sb) < 0 || !sb.st_size)
+    return close(fd), printf("Error: cannot 'stat' file '%s'\n", fname), NULL;
+
+  u8 *map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return printf("Error: cannot map file '%s'\n", fname), NULL;
+
+  ppm_t *p = malloc(sizeof(ppm_t));
+
+  if (!p)
+    return munmap(map, sb.st_size), printf("Error: cannot allocate memory for ppm file\n"), NULL;
+
+  u64 off = parse_ppm_header(map, sb.st_size, &p->w, &p->h, &p->t);
+
+  if (!off)
+    return munmap(map, sb.st_size), free(p), printf("Error: only PPM P6 binary format is handled\n"), NULL;
+
+  if (sb.st_size - off < p->w * p->h * 3)
+    return munmap(map, sb.st_size), free(p), printf("Error: mismatch between file size and image resolution\n"), NULL;
+
+  madvise(map, sb.st_size, MADV_SEQUENTIAL);
+
+  p->map = map;
+  p->size = sb.st_size;
+  p->pixels = map + off;
+
+  return p;
+}
+
+//Loader for pipelines: the header is parsed from a small pread, the pixels
+//are read with pread straight into their buffer (no stdio copy)
+ppm_t *read_ppm(const char *fname)
+{
+  u8 hdr[256];
+  struct stat sb;
+  int fd = open(fname, O_RDONLY);
+
+  if (fd < 0)
+    return printf("Error: cannot open file '%s'\n", fname), NULL;
+
+  ssize_t n = pread(fd, hdr, sizeof(hdr), 0);
+
+  if (n <= 0 || fstat(fd, &sb) < 0)
+    return close(fd), printf("Error: cannot read file '%s'\n", fname), NULL;
+
+  ppm_t *p = malloc(sizeof(ppm_t));
+
+  if (!p)
+    return close(fd), printf("Error: cannot allocate memory for ppm file\n"), NULL;
+
+  u64 off = parse_ppm_header(hdr, n, &p->w, &p->h, &p->t);
+  u64 len = p->w * p->h * 3;
+
+  if (!off || (u64)sb.st_size - off < len)
+    return close(fd), free(p), printf("Error: '%s' is not a valid PPM P6 file\n", fname), NULL;
+
+  p->map = NULL;
+  p->size = 0;
+  p->pixels = malloc(len);
+
+  if (!p->pixels)
+    return close(fd), free(p), printf("Error: cannot allocate memory for pixels\n"), NULL;
+
+  for (u64 r = 0; r < len; )
+    {
+      ssize_t k = pread(fd, p->pixels + r, len - r, off + r);
+
+      if (k <= 0)
+	return close(fd), free(p->pixels), free(p), printf("Error: cannot read file '%s'\n", fname), NULL;
+
+      r += k;
+    }
+
+  close(fd);
+
+  return p;
+}
+
+//Output image backed by its file: the header is written, the file is sized
+//and mapped shared, a filter writing p->pixels fills the file directly
+ppm_t *create_ppm_mmap(const char *fname, u64 w, u64 h, u64 t)
+{
+  char hdr[64];
+  int len = snprintf(hdr, sizeof(hdr), "P6\n%llu %llu\n%llu\n", w, h, t);
+  int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    return printf("Error: cannot create file '%s'\n", fname), NULL;
+
+  u64 size = len + (w * h * 3);
+
+  if (ftruncate(fd, size) < 0)
+    return close(fd), printf("Error: cannot resize file '%s'\n", fname), NULL;
+
+  u8 *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return printf("Error: cannot map file '%s'\n", fname), NULL;
+
+  ppm_t *p = malloc(sizeof(ppm_t));
+
+  if (!p)
+    return munmap(map, size), printf("Error: cannot allocate memory for ppm\n"), NULL;
+
+  memcpy(map, hdr, len);
+
+  p->w = w;
+  p->h = h;
+  p->t = t;
+  p->map = map;
+  p->size = size;
+  p->pixels = map + len;
+
+  return p;
+}
+
+//pwritev until everything is written: one call writes at most 0x7ffff000
+//bytes on Linux, so large images take several. Returns 0 or -1.
+static inline int pwritev_all(int fd, struct iovec *iov, int n, off_t off)
+{
+  while (n)
+    {
+      ssize_t k = pwritev(fd, iov, n, off);
+
+      if (k <= 0)
+	return -1;
+
+      off += k;
+
+      //Drops the vectors fully written, advances the partial one
+      for (; n && (size_t)k >= iov->iov_len; n--, iov++)
+	k -= iov->iov_len;
+
+      if (n)
+	{
+	  iov->iov_base = (u8 *)iov->iov_base + k;
+	  iov->iov_len -= k;
+	}
+    }
+
+  return 0;
+}
+
+//Header and pixels in as few system calls as possible
+void write_ppm_pwrite(ppm_t *p, const char *fname)
+{
+  if (!p || !fname)
+    printf("Error: pointer is NULL"), exit(-1);
+
+  char hdr[64];
+  int len = snprintf(hdr, sizeof(hdr), "P6\n%llu %llu\n%llu\n", p->w, p->h, p->t);
+  int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    printf("Error: cannot create file '%s'\n", fname), exit(-1);
+
+  struct iovec iov[2] = { { hdr, len }, { p->pixels, p->w * p->h * 3 } };
+
+  if (pwritev_all(fd, iov, 2, 0) < 0)
+    printf("Error: cannot write file '%s'\n", fname), exit(-1);
+
+  close(fd);
+}
+
+//In-place transform: f reads and writes the same pixels
+void ppm_apply(ppm_t *p, void (*f)(u8 *, u64, u8 *))
+{
+  f(p->pixels, p->w * p->h * 3, p->pixels);
+}
+
+//
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
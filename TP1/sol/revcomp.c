@@ -0,0 +1,370 @@
+//In-place reverse complement of DNA sequences, text or packed 2-bit
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "dna2.h"
+#include "seq.h"
+
+//
+typedef struct {
+
+  //Sequence, and the range [lo, hi) of the first half swapped by the thread
+  u8 *s;
+  u64 n, lo, hi;
+
+  //
+  pthread_t tid;
+
+} rc_thread_t;
+
+//Complement of every byte: A <-> T, C <-> G in both cases, anything else unchanged
+u8 comp[256];
+
+//
+void comp_init()
+{
+  for (int i = 0; i < 256; i++)
+    comp[i] = i;
+
+  comp['A'] = 'T'; comp['T'] = 'A'; comp['C'] = 'G'; comp['G'] = 'C';
+  comp['a'] = 't'; comp['t'] = 'a'; comp['c'] = 'g'; comp['g'] = 'c';
+}
+
+//Swaps and complements s[i] and s[n - 1 - i] for lo <= i < hi <= n / 2
+void revcomp_c_range(u8 *s, u64 n, u64 lo, u64 hi)
+{
+  for (u64 i = lo; i < hi; i++)
+    {
+      u8 a = s[i];
+
+      s[i] = comp[s[n - 1 - i]];
+      s[n - 1 - i] = comp[a];
+    }
+}
+
+//Complement of 32 bytes: the low nibble of A, C, G, T (1, 3, 7, 4) selects
+//the xor that swaps the pair (A ^ T = 0x15, C ^ G = 0x04, case bit untouched),
+//a second vpshufb checks the byte really is that letter
+__attribute__((target("avx2")))
+static inline __m256i comp_avx2(__m256i v)
+{
+  const __m256i delta = _mm256_setr_epi8(0, 0x15, 0, 0x04, 0x15, 0, 0, 0x04, 0, 0, 0, 0, 0, 0, 0, 0,
+					 0, 0x15, 0, 0x04, 0x15, 0, 0, 0x04, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i letter = _mm256_setr_epi8(0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0,
+					  0, 'a', 0, 'c', 't', 0, 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0);
+  __m256i nib = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+  __m256i ok = _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_shuffle_epi8(letter, nib));
+
+  return _mm256_xor_si256(v, _mm256_and_si256(_mm256_shuffle_epi8(delta, nib), ok));
+}
+
+//Byte reversal of 32 bytes: vpshufb inside the lanes, then the lanes are swapped
+__attribute__((target("avx2")))
+static inline __m256i rev_avx2(__m256i v)
+{
+  const __m256i r = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+				     15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+  return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, r), 0x4e);
+}
+
+//32 bytes from each end per iteration, working inward
+__attribute__((target("avx2")))
+void revcomp_avx2_range(u8 *s, u64 n, u64 lo, u64 hi)
+{
+  u64 i = lo;
+
+  for (; i + 32 <= hi; i += 32)
+    {
+      __m256i *f = (__m256i *)(s + i);
+      __m256i *b = (__m256i *)(s + n - i - 32);
+      __m256i vf = _mm256_loadu_si256(f);
+      __m256i vb = _mm256_loadu_si256(b);
+
+      _mm256_storeu_si256(f, comp_avx2(rev_avx2(vb)));
+      _mm256_storeu_si256(b, comp_avx2(rev_avx2(vf)));
+    }
+
+  revcomp_c_range(s, n, i, hi);
+}
+
+//Whole sequence, the middle base of odd lengths is only complemented
+void revcomp_c(u8 *s, u64 n)
+{
+  revcomp_c_range(s, n, 0, n / 2);
+
+  if (n & 1)
+    s[n / 2] = comp[s[n / 2]];
+}
+
+//
+void revcomp_avx2(u8 *s, u64 n)
+{
+  revcomp_avx2_range(s, n, 0, n / 2);
+
+  if (n & 1)
+    s[n / 2] = comp[s[n / 2]];
+}
+
+//
+void *_revcomp_(void *arg)
+{
+  rc_thread_t *t = arg;
+
+  if (__builtin_cpu_supports("avx2"))
+    revcomp_avx2_range(t->s, t->n, t->lo, t->hi);
+  else
+    revcomp_c_range(t->s, t->n, t->lo, t->hi);
+
+  return NULL;
+}
+
+//The first half is split in nt ranges, each thread also owns the mirror range
+void revcomp_threads(u8 *s, u64 n, u64 nt)
+{
+  rc_thread_t *t = malloc(nt * sizeof(rc_thread_t));
+  u64 half = n / 2, part = (half / nt) & ~31ULL;
+
+  if (!t)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      t[i].s = s;
+      t[i].n = n;
+      t[i].lo = i * part;
+      t[i].hi = (i == nt - 1) ? half : (i + 1) * part;
+
+      pthread_create(&t[i].tid, NULL, _revcomp_, &t[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    pthread_join(t[i].tid, NULL);
+
+  if (n & 1)
+    s[half] = comp[s[half]];
+
+  free(t);
+}
+
+//Packed reference, one base at a time
+void revcomp_packed_c(u8 *p, u64 len)
+{
+  for (u64 i = 0, j = len - 1; len && i < j; i++, j--)
+    {
+      u64 a = (p[i >> 2] >> (2 * (i & 3))) & 3;
+      u64 b = (p[j >> 2] >> (2 * (j & 3))) & 3;
+
+      p[i >> 2] = (p[i >> 2] & ~(3 << (2 * (i & 3)))) | ((b ^ 2) << (2 * (i & 3)));
+      p[j >> 2] = (p[j >> 2] & ~(3 << (2 * (j & 3)))) | ((a ^ 2) << (2 * (j & 3)));
+    }
+
+  if (len & 1)
+    p[(len / 2) >> 2] ^= 2 << (2 * ((len / 2) & 3));
+}
+
+//Packed bytes: byte order reversed with vpshufb, the 4 fields inside each
+//byte reversed with two nibble tables, complement is xor 0xaa (code ^ 2).
+//When len is not a multiple of 4 the padding ends up in front and the whole
+//array is shifted down by 2 bits per padding base.
+__attribute__((target("avx2")))
+void revcomp_packed_avx2(u8 *p, u64 len)
+{
+  const __m256i lo_tab = _mm256_setr_epi8(0x00, 0x40, 0x80, 0xc0, 0x10, 0x50, 0x90, 0xd0,
+					  0x20, 0x60, 0xa0, 0xe0, 0x30, 0x70, 0xb0, 0xf0,
+					  0x00, 0x40, 0x80, 0xc0, 0x10, 0x50, 0x90, 0xd0,
+					  0x20, 0x60, 0xa0, 0xe0, 0x30, 0x70, 0xb0, 0xf0);
+  const __m256i hi_tab = _mm256_setr_epi8(0x0, 0x4, 0x8, 0xc, 0x1, 0x5, 0x9, 0xd,
+					  0x2, 0x6, 0xa, 0xe, 0x3, 0x7, 0xb, 0xf,
+					  0x0, 0x4, 0x8, 0xc, 0x1, 0x5, 0x9, 0xd,
+					  0x2, 0x6, 0xa, 0xe, 0x3, 0x7, 0xb, 0xf);
+  const __m256i low = _mm256_set1_epi8(0x0f), aa = _mm256_set1_epi8(0xaa);
+  u8 rev[256];
+  u64 n = (len + 3) / 4, i = 0;
+
+#define FIELDS(v) _mm256_xor_si256(_mm256_or_si256(_mm256_shuffle_epi8(lo_tab, _mm256_and_si256(v, low)), \
+						   _mm256_shuffle_epi8(hi_tab, _mm256_and_si256(_mm256_srli_epi16(v, 4), low))), aa)
+
+  for (; i + 32 <= n / 2; i += 32)
+    {
+      __m256i *f = (__m256i *)(p + i);
+      __m256i *b = (__m256i *)(p + n - i - 32);
+      __m256i vf = _mm256_loadu_si256(f);
+      __m256i vb = _mm256_loadu_si256(b);
+
+      _mm256_storeu_si256(f, FIELDS(rev_avx2(vb)));
+      _mm256_storeu_si256(b, FIELDS(rev_avx2(vf)));
+    }
+
+#undef FIELDS
+
+  //Same per byte through a table
+  for (int x = 0; x < 256; x++)
+    rev[x] = (((x & 3) << 6) | (((x >> 2) & 3) << 4) | (((x >> 4) & 3) << 2) | (x >> 6)) ^ 0xaa;
+
+  for (; i < n / 2; i++)
+    {
+      u8 a = p[i];
+
+      p[i] = rev[p[n - 1 - i]];
+      p[n - 1 - i] = rev[a];
+    }
+
+  if (n & 1)
+    p[n / 2] = rev[p[n / 2]];
+
+  //Drop the leading padding
+  u64 shift = 2 * ((4 - (len & 3)) & 3);
+
+  if (shift)
+    {
+      for (i = 0; i + 8 < n; i += 7)
+	{
+	  u64 w;
+
+	  memcpy(&w, p + i, 8);
+	  w >>= shift;
+	  memcpy(p + i, &w, 7);
+	}
+
+      for (; i + 1 < n; i++)
+	p[i] = (p[i] >> shift) | (p[i + 1] << (8 - shift));
+
+      p[n - 1] >>= shift;
+    }
+}
+
+//Writes the whole buffer with as few system calls as possible
+int write_all(const char *fname, u8 *p, u64 n)
+{
+  int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+    return printf("Error: cannot create file '%s'\n", fname), -1;
+
+  for (u64 w = 0; w < n; )
+    {
+      ssize_t k = write(fd, p + w, n - w);
+
+      if (k <= 0)
+	return close(fd), printf("Error: cannot write '%s'\n", fname), -1;
+
+      w += k;
+    }
+
+  close(fd);
+
+  return 0;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+    return printf("Usage: %s [seq] [output] [threads]\n", argv[0]), 1;
+
+  u64 nt = (argc > 3) ? atoll(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
+  comp_init();
+
+  //Private mapping: the input file is never modified
+  seq_t *s = load_seq_mmap(argv[1], 0);
+
+  if (!s)
+    error();
+
+  u8 *orig = malloc(s->len);
+  double b, a;
+
+  if (!orig)
+    return printf("Error: cannot allocate memory\n"), 3;
+
+  memcpy(orig, s->bases, s->len);
+
+  if (s->len >= DNA2_HDR && !memcmp(s->bases, DNA2_MAGIC, 8))
+    {
+      u8 *p = s->bases + DNA2_HDR;
+      u64 len;
+
+      void (*packed)(u8 *, u64) = __builtin_cpu_supports("avx2") ? revcomp_packed_avx2 : revcomp_packed_c;
+
+      memcpy(&len, s->bases + 8, sizeof(u64));
+
+      //Truncated or padded file, same check as pack_seq in 5.c
+      if (s->len - DNA2_HDR != (len + 3) / 4)
+	return printf("Error: '%s' holds %llu bytes for %llu bases\n", argv[1], s->len - DNA2_HDR, len), 5;
+
+      //The reference undoes the SIMD version
+      if (packed != revcomp_packed_c)
+	{
+	  b = now(); revcomp_packed_avx2(p, len); a = now();
+
+	  printf("revcomp_packed_avx2: %.3lf s, %.3lf Gbases/s\n", a - b, len / (a - b) / 1e9);
+
+	  b = now(); revcomp_packed_c(p, len); a = now();
+
+	  printf("revcomp_packed_c   : %.3lf s, %.3lf Gbases/s %s\n", a - b, len / (a - b) / 1e9,
+		 memcmp(s->bases, orig, s->len) ? "(MISMATCH)" : "");
+	}
+
+      packed(p, len);
+    }
+  else
+    {
+      u64 n = s->len;
+
+      //Trailing newline stays in place
+      while (n && (s->bases[n - 1] == '\n' || s->bases[n - 1] == '\r'))
+	n--;
+
+      //Each version is checked by undoing it with the reference
+      struct { const char *name; void (*f)(u8 *, u64); int ok; } kernels[] = {
+
+	{ "revcomp_avx2   ", revcomp_avx2, __builtin_cpu_supports("avx2") },
+	{ "revcomp_threads", NULL,         1 },
+	{ NULL, NULL, 0 }
+      };
+
+      b = now(); revcomp_c(s->bases, n); a = now();
+
+      printf("revcomp_c      : %.3lf s, %.3lf GB/s\n", a - b, n / (a - b) / 1e9);
+
+      revcomp_c(s->bases, n);
+
+      for (int k = 0; kernels[k].name; k++)
+	{
+	  if (!kernels[k].ok)
+	    continue;
+
+	  b = now();
+
+	  if (kernels[k].f)
+	    kernels[k].f(s->bases, n);
+	  else
+	    revcomp_threads(s->bases, n, nt);
+
+	  a = now();
+
+	  revcomp_c(s->bases, n);
+
+	  printf("%s: %.3lf s, %.3lf GB/s %s\n", kernels[k].name, a - b, n / (a - b) / 1e9,
+		 memcmp(s->bases, orig, s->len) ? "(MISMATCH)" : "");
+	}
+
+      revcomp_threads(s->bases, n, nt);
+    }
+
+  if (write_all(argv[2], s->bases, s->len) < 0)
+    return 4;
+
+  free(orig);
+  release_seq(s); free(s);
+
+  return 0;
+}
@@ -0,0 +1,320 @@
+//k-mismatch pattern search: every offset where a pattern matches a sequence
+//with at most k substituted bases
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "seq.h"
+
+//Hit positions kept by the benchmark
+#define MAX_HITS (1 << 20)
+
+//
+typedef unsigned int u32;
+
+//
+typedef u64 (*search_fn)(u8 *, u64, u8 *, u64, u64, u64 *, u64);
+
+//
+typedef struct {
+
+  //Text range owned by the thread: offsets lo <= i < hi
+  u8 *t;
+  u64 n, lo, hi;
+
+  //Pattern and allowed mismatches
+  u8 *p;
+  u64 m, k;
+
+  //Hit positions (up to max) and total count
+  u64 *hits, max, count;
+
+  //
+  search_fn f;
+  pthread_t tid;
+
+} search_thread_t;
+
+//Stores a hit position if there is room, always counts it
+#define HIT(pos)				\
+  do						\
+    {						\
+      if (h < max)				\
+	hits[h] = (pos);			\
+      h++;					\
+    }						\
+  while (0)
+
+//Reference: mismatches are counted at every offset, stopping past k
+u64 search_c(u8 *t, u64 n, u8 *p, u64 m, u64 k, u64 *hits, u64 max)
+{
+  u64 h = 0;
+
+  for (u64 i = 0; i + m <= n; i++)
+    {
+      u64 e = 0;
+
+      for (u64 j = 0; j < m && e <= k; j++)
+	e += (t[i + j] != p[j]);
+
+      if (e <= k)
+	HIT(i);
+    }
+
+  return h;
+}
+
+//Shift-And with substitutions (m <= 64): bit j of r[d] is set when p[0..j]
+//ends at the current text position with at most d mismatches. A mismatch
+//extends the state of level d - 1 from the previous position.
+u64 search_shift_and(u8 *t, u64 n, u8 *p, u64 m, u64 k, u64 *hits, u64 max)
+{
+  if (m > 64 || m > n)
+    return 0;
+
+  //More than m mismatches never happen
+  if (k > m)
+    k = m;
+
+  u64 b[256] = { 0 }, r[k + 1], last = 1ULL << (m - 1), h = 0;
+
+  for (u64 j = 0; j < m; j++)
+    b[p[j]] |= 1ULL << j;
+
+  memset(r, 0, sizeof(r));
+
+  for (u64 i = 0; i < n; i++)
+    {
+      u64 mask = b[t[i]], prev = r[0];
+
+      r[0] = ((r[0] << 1) | 1) & mask;
+
+      for (u64 d = 1; d <= k; d++)
+	{
+	  u64 cur = r[d];
+
+	  r[d] = (((cur << 1) | 1) & mask) | ((prev << 1) | 1);
+	  prev = cur;
+	}
+
+      if (r[k] & last)
+	HIT(i + 1 - m);
+    }
+
+  return h;
+}
+
+//Packed compare: 32 consecutive offsets at a time, each pattern base is
+//broadcast and compared to 32 text bytes, mismatches go into saturating
+//byte counters. The block stops early once every offset is past k.
+__attribute__((target("avx2")))
+u64 search_avx2(u8 *t, u64 n, u8 *p, u64 m, u64 k, u64 *hits, u64 max)
+{
+  if (m > n)
+    return 0;
+
+  //Saturated counters cannot tell 255 from more
+  if (k >= 255)
+    return search_c(t, n, p, m, k, hits, max);
+
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i vk  = _mm256_set1_epi8(k);
+  u64 offsets = n - m + 1, i = 0, h = 0;
+
+  for (; i + 32 <= offsets; i += 32)
+    {
+      __m256i cnt = _mm256_setzero_si256();
+      u32 ok = ~0U;
+
+      for (u64 j = 0; j < m; j++)
+	{
+	  __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(t + i + j)), _mm256_set1_epi8(p[j]));
+
+	  cnt = _mm256_adds_epu8(cnt, _mm256_andnot_si256(eq, one));
+
+	  if ((j & 15) == 15)
+	    {
+	      ok = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(cnt, vk), cnt));
+
+	      if (!ok)
+		break;
+	    }
+	}
+
+      //Offsets with cnt <= k
+      ok &= _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(cnt, vk), cnt));
+
+      while (ok)
+	{
+	  HIT(i + __builtin_ctz(ok));
+	  ok &= ok - 1;
+	}
+    }
+
+  //Remaining offsets
+  if (i < offsets)
+    {
+      u64 r = search_c(t + i, n - i, p, m, k, (h < max) ? hits + h : NULL, (h < max) ? max - h : 0);
+
+      for (u64 j = h; j < h + r && j < max; j++)
+	hits[j] += i;
+
+      h += r;
+    }
+
+  return h;
+}
+
+//Fastest kernel for this CPU and pattern
+search_fn search_best(u64 m)
+{
+  if (__builtin_cpu_supports("avx2"))
+    return search_avx2;
+
+  if (m <= 64)
+    return search_shift_and;
+
+  return search_c;
+}
+
+//
+void *_search_(void *arg)
+{
+  search_thread_t *st = arg;
+
+  //Offsets of the last window end m - 1 bytes past hi
+  u64 end = (st->hi + st->m - 1 < st->n) ? st->hi + st->m - 1 : st->n;
+
+  st->count = st->f(st->t + st->lo, end - st->lo, st->p, st->m, st->k, st->hits, st->max);
+
+  for (u64 i = 0; i < st->count && i < st->max; i++)
+    st->hits[i] += st->lo;
+
+  return NULL;
+}
+
+//Text split in nt contiguous ranges of offsets, hits merged in order
+u64 search_threads(u8 *t, u64 n, u8 *p, u64 m, u64 k, u64 *hits, u64 max, u64 nt)
+{
+  if (m > n)
+    return 0;
+
+  search_thread_t *st = malloc(nt * sizeof(search_thread_t));
+  u64 offsets = n - m + 1, step = (offsets + nt - 1) / nt, h = 0;
+
+  if (!st)
+    printf("Error: cannot allocate memory\n"), exit(-1);
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      st[i].t = t;
+      st[i].n = n;
+      st[i].lo = (i * step < offsets) ? i * step : offsets;
+      st[i].hi = (st[i].lo + step < offsets) ? st[i].lo + step : offsets;
+      st[i].p = p;
+      st[i].m = m;
+      st[i].k = k;
+      st[i].max = max;
+      st[i].hits = malloc(max * sizeof(u64));
+      st[i].f = search_best(m);
+
+      if (!st[i].hits)
+	printf("Error: cannot allocate memory\n"), exit(-1);
+
+      pthread_create(&st[i].tid, NULL, _search_, &st[i]);
+    }
+
+  for (u64 i = 0; i < nt; i++)
+    {
+      pthread_join(st[i].tid, NULL);
+
+      for (u64 j = 0; j < st[i].count && j < st[i].max && h + j < max; j++)
+	hits[h + j] = st[i].hits[j];
+
+      h += st[i].count;
+      free(st[i].hits);
+    }
+
+  free(st);
+
+  return h;
+}
+
+//
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+    return printf("Usage: %s [seq] [pattern] [k] [threads]\n", argv[0]), 1;
+
+  seq_t *s = load_seq_mmap(argv[1], 0);
+
+  if (!s)
+    error();
+
+  u64 n = s->len;
+
+  //Trailing newline is not part of the sequence
+  while (n && (s->bases[n - 1] == '\n' || s->bases[n - 1] == '\r'))
+    n--;
+
+  u8 *p = (u8 *)argv[2];
+  u64 m = strlen(argv[2]);
+  u64 k = atoll(argv[3]);
+  u64 nt = (argc > 4) ? atoll(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (!m || m > n)
+    return printf("Error: pattern length must be in [1, %llu]\n", n), 2;
+
+  if (!nt)
+    return printf("Error: number of threads must be > 0\n"), 2;
+
+  u64 *ref = malloc(MAX_HITS * sizeof(u64));
+  u64 *hits = malloc(MAX_HITS * sizeof(u64));
+
+  if (!ref || !hits)
+    return printf("Error: cannot allocate memory\n"), 3;
+
+  double b = now();
+  u64 h_ref = search_c(s->bases, n, p, m, k, ref, MAX_HITS);
+  double a = now();
+
+  printf("%-16s: %10llu hits, %.3lf s, %10.3lf Mhits/s, %8.3lf Mbases/s\n", "search_c",
+	 h_ref, a - b, h_ref / (a - b) / 1e6, n / (a - b) / 1e6);
+
+  struct { const char *name; search_fn f; int ok; } kernels[] = {
+
+    { "search_shift_and", search_shift_and, m <= 64 },
+    { "search_avx2",      search_avx2,      __builtin_cpu_supports("avx2") },
+    { NULL, NULL, 0 }
+  };
+
+  for (u64 i = 0; kernels[i].name; i++)
+    {
+      if (!kernels[i].ok)
+	continue;
+
+      b = now();
+      u64 h = kernels[i].f(s->bases, n, p, m, k, hits, MAX_HITS);
+      a = now();
+
+      printf("%-16s: %10llu hits, %.3lf s, %10.3lf Mhits/s, %8.3lf Mbases/s %s\n", kernels[i].name,
+	     h, a - b, h / (a - b) / 1e6, n / (a - b) / 1e6,
+	     (h != h_ref || memcmp(hits, ref, ((h < MAX_HITS) ? h : MAX_HITS) * sizeof(u64))) ? "(MISMATCH)" : "");
+    }
+
+  b = now();
+  u64 h = search_threads(s->bases, n, p, m, k, hits, MAX_HITS, nt);
+  a = now();
+
+  printf("%-16s: %10llu hits, %.3lf s, %10.3lf Mhits/s, %8.3lf Mbases/s (%llu threads) %s\n", "search_threads",
+	 h, a - b, h / (a - b) / 1e6, n / (a - b) / 1e6, nt,
+	 (h != h_ref || memcmp(hits, ref, ((h < MAX_HITS) ? h : MAX_HITS) * sizeof(u64))) ? "(MISMATCH)" : "");
+
+  free(ref);
+  free(hits);
+  release_seq(s); free(s);
+
+  return 0;
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+//Sequences loaded from files, shared by the DNA programs
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+//Defining error codes
+#define ERR_FNAME_NULL   0
+#define ERR_MALLOC_NULL  1
+#define ERR_STAT         3
+#define ERR_OPEN_FILE    4
+#define ERR_READ_BYTES   5
+#define ERR_NULL_POINTER 6
+#define ERR_MMAP         7
+
+//
+typedef unsigned char      u8;
+typedef unsigned long long u64;
+
+//Sequence definitions 
+typedef struct {
+
+  //Sequence elements/bytes
+  u8 *bases;  //这是一个 u8 指针，用于存储序列的元素或字节数据。可以被视为一个指向字节数组的指针。
+
+  //Sequence length
+  u64 len;    //表示序列的长度，即序列中包含的元素或字节的数量。
+
+  //Set when bases is a file mapping: release_seq unmaps instead of freeing
+  u8 mapped;
+
+} seq_t; //这是一个用户定义的结构体，用于表示序列数据。
+//使用这些类型和结构体，您可以创建和操作序列数据，其中 seq_t 结构体包含了序列的元素和长度信息。
+//这种抽象的表示使得处理序列数据更加灵活和可维护，可以方便地传递和操作序列数据。
+
+
+//Global error variable
+u64 err_id = 0;
+
+//Error messages
+const char *err_msg[] = {
+
+  [ERR_FNAME_NULL]   = "file name pointer NULL",
+  [ERR_MALLOC_NULL]  = "memory allocation fail, 'malloc' returned NULL",
+  [ERR_STAT]         = "cannot 'stat' file",
+  [ERR_OPEN_FILE]    = "cannot open file, 'fopen' returned NULL",
+  [ERR_READ_BYTES]   = "mismatch between read bytes and file length",
+  [ERR_NULL_POINTER] = "NULL pointer",
+  [ERR_MMAP]         = "cannot map file, 'mmap' failed",
+  
+  NULL
+};
+
+//这是一个用于获取时间戳计数（TSC，Time Stamp Counter）值的内联汇编函数。
+//TSC是一个CPU寄存器，通常用于度量CPU执行指令的时钟周期数，以测量程序执行时间和性能。
+static inline u64 rdtsc()
+{
+  u64 a, d;  //声明两个64位无符号整数变量 a 和 d，用于存储TSC值的低32位和高32位。
+  
+  __asm__ volatile ("rdtsc" : "=a" (a), "=d" (d)); 
+  //这是内联汇编代码，执行了RDTSC（Read Time-Stamp Counter）指令，该指令将TSC的值读入寄存器EAX和EDX。
+  //内联汇编使用了扩展的内联汇编语法，其中 "rdtsc" 是汇编指令，"=a" 和 "=d" 指示将结果分别返回给变量 a 和 d。
+
+  return ((d << 32) | a); //通过将 d 左移32位并与 a 进行位或操作，将获取的TSC值合并为一个64位的无符号整数，然后将其作为函数的返回值。
+} //这个函数允许程序在需要测量执行时间或性能时获取TSC计数值。由于TSC的计数单位是CPU时钟周期，因此可以使用它来进行精确的时间测量。
+  //TSC值在不同的CPU和系统上可能有不同的行为，因此在跨平台应用中需要小心处理。
+
+//Wall clock time in seconds
+static inline double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//Resident set size in bytes
+static inline u64 rss()
+{
+  u64 size = 0, res = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+
+  if (fp)
+    {
+      if (fscanf(fp, "%llu %llu", &size, &res) != 2)
+	res = 0;
+      
+      fclose(fp);
+    }
+  
+  return res * sysconf(_SC_PAGESIZE);
+}
+
+//
+void error()
+{
+  //打印错误消息，其中包括错误标识符 err_id 和与该错误标识符相关的错误消息 err_msg[err_id]。
+  //这将在标准输出中显示错误的描述，以帮助程序员或用户理解错误的类型和原因。
+  printf("Error (%llu): %s\n", err_id, err_msg[err_id]);
+  
+  //调用 exit 函数，终止程序的执行并返回退出状态 -1，表示程序因错误而非正常退出。
+  //这将终止程序的执行并返回一个错误状态，以通知调用者或操作系统发生了错误。
+  exit(-1);
+} //在错误处理中，当某个函数或操作遇到错误情况时，通常会调用类似 error 函数来报告和处理错误。
+  //这有助于提高程序的可维护性和可读性，因为错误处理的代码可以在一个地方进行集中管理，而不需要在多个地方分散处理错误。
+  //同时，使用错误消息和错误标识符也可以更好地记录和诊断程序中发生的错误。
+
+//
+seq_t *load_seq(const char *fname)
+{
+  //首先检查传递给函数的文件名指针 fname 是否为 NULL。如果是 NULL，表示文件名未提供，
+  //因此将错误标识符 err_id 设置为 ERR_FNAME_NULL，并返回 NULL 指针，表示出现了错误。
+  if (!fname)
+    {
+      err_id = ERR_FNAME_NULL;
+      return NULL;
+    }
+
+  //创建一个名为 sb 的结构体，用于存储文件状态信息，包括文件大小等。
+  struct stat sb;
+
+  //使用 stat 函数获取文件 fname 的状态信息，并将结果存储在 sb 结构体中。
+  //如果 stat 函数返回小于0的值（通常是-1），表示获取状态信息失败，可能是因为文件不存在或其他问题。
+  //在这种情况下，将错误标识符 err_id 设置为 ERR_STAT，并返回 NULL 指针，表示出现了错误。
+  if (stat(fname, &sb) < 0)
+    {
+      err_id = ERR_STAT;
+      return NULL;
+    }
+  
+  //Allocate sequence 
+  //在这里，为存储序列数据的 seq_t 结构体分配内存，并将指针存储在 s 中。
+  //如果内存分配失败，将错误标识符 err_id 设置为 ERR_MALLOC_NULL，并返回 NULL 指针，表示出现了错误。
+  seq_t *s = malloc(sizeof(seq_t));
+  
+  if (!s)
+    {
+      err_id = ERR_MALLOC_NULL;
+      return NULL;
+    }
+  
+  //Length of sequence is file size in bytes
+  //将结构体 seq_t 中的 s->len 成员设置为 sb.st_size，其中 sb.st_size 是一个表示文件大小的变量，通常是通过文件状态信息（stat）获得的。
+  //这行代码将文件的大小分配给序列结构体中的 len 成员，以表示序列的长度。
+  s->len = sb.st_size; 
+  s->mapped = 0;
+
+  //Allocating memory for sequence bases
+  //为存储序列元素或字节数据的数组 s->bases 分配内存。分配的内存大小是 sb.st_size 乘以 sizeof(u8)，即文件大小乘以一个字节的大小。
+  //这将创建一个能够容纳整个序列的内存块，并将指向该内存块的指针存储在 s->bases 成员中。
+  s->bases = malloc(sizeof(u8) * sb.st_size);
+  
+  if (!s->bases) //在动态内存分配失败时执行以下操作。
+    {
+      err_id = ERR_MALLOC_NULL;  //将错误标识符 err_id 设置为 ERR_MALLOC_NULL，表示内存分配失败的错误类型。
+      return NULL;  //返回 NULL 指针，表示内存分配失败，可能需要进行错误处理。
+    } //这段代码的主要目的是为表示序列数据的结构体 seq_t 分配内存，并将文件大小分配给序列的长度 len，
+      //以便可以在这个内存块中存储序列的元素。如果内存分配失败，它会设置错误标识符，并返回 NULL 指针以指示错误状态。
+      //这是在处理从文件读取的序列数据时执行的初始化操作。
+
+  //Opening the file
+  //使用 fopen 函数以只读二进制模式打开指定文件 fname。
+  //如果打开文件失败（fp 为 NULL），则将错误标识符 err_id 设置为 ERR_OPEN_FILE，表示无法打开文件，然后返回 NULL 指针，表示出现了错误。
+  FILE *fp = fopen(fname, "rb");
+
+  if (!fp)
+    {
+      err_id = ERR_OPEN_FILE;
+      return NULL;
+    }
+
+  //Reading bytes from file
+  //使用 fread 函数从已经打开的文件中读取数据，读取的数据存储在 s->bases 中。s->len 表示要读取的元素数量，sizeof(u8) 表示每个元素的大小。
+  //read_bytes 存储了实际读取的字节数。如果读取失败，read_bytes 的值可能小于 s->len。
+  size_t read_bytes = fread(s->bases, sizeof(u8), s->len, fp);
+
+  //Closing file
+  //使用 fclose 函数关闭已经打开的文件，释放文件资源。
+  fclose(fp);
+
+  //Check if bytes were fully read
+  //检查是否读取的字节数等于 s->len，如果不相等，将错误标识符 err_id 设置为 ERR_READ_BYTES，表示读取的字节数与序列的长度不匹配，
+  //然后返回 NULL 指针，表示出现了错误。
+  if (read_bytes != s->len)
+    {
+      err_id = ERR_READ_BYTES;
+      return NULL;
+    }
+  
+  //如果一切正常，s 将包含加载的序列数据。
+  return s;
+}
+
+//释放 seq_t 结构体及其关联的内存
+void release_seq(seq_t *s)
+{
+  //检查传递给函数的 seq_t 结构体指针 s 是否为非空
+  //确保不会对空指针执行释放操作
+  if (s)
+    {
+      //如果 seq_t 结构体中的 s->bases 成员（存储序列数据的指针）非空，则执行以下操作：
+      if (s->bases)  
+	{
+	  if (s->mapped)
+	    munmap(s->bases, s->len);
+	  else
+	    free(s->bases);  //释放 s->bases 指向的内存块，这是为存储序列数据而分配的内存。
+
+	  s->bases = NULL;
+	}
+      else
+	err_id = ERR_NULL_POINTER;  //将错误标识符 err_id 设置为 ERR_NULL_POINTER，表示尝试释放一个空指针。
+	  
+      //将 s->len 设置为0，表示序列长度为0
+      s->len = 0;
+    }
+  else
+    err_id = ERR_NULL_POINTER; //如果 seq_t 结构体指针 s 为空，则将错误标识符 err_id 设置为 ERR_NULL_POINTER，表示尝试释放一个空指针。
+} //这个函数用于在释放 seq_t 结构体及其关联的内存时进行安全的操作。
+  //它会检查指针的有效性，释放内存并清除相关数据，同时记录任何可能的错误情况。
+  //这有助于避免释放无效的内存或空指针，并提高程序的稳定性。
+
+//Zero-copy loader: the file is mapped private (in-place transforms get
+//copy-on-write pages, the file is never modified) and the kernel is told
+//the access pattern so readahead starts right away. huge asks for
+//transparent huge pages, which is only a hint.
+seq_t *load_seq_mmap(const char *fname, int huge)
+{
+  if (!fname)
+    {
+      err_id = ERR_FNAME_NULL;
+      return NULL;
+    }
+
+  int fd = open(fname, O_RDONLY);
+
+  if (fd < 0)
+    {
+      err_id = ERR_OPEN_FILE;
+      return NULL;
+    }
+
+  struct stat sb;
+
+  if (fstat(fd, &sb) < 0)
+    {
+      err_id = ERR_STAT;
+      return close(fd), NULL;
+    }
+
+  seq_t *s = malloc(sizeof(seq_t));
+
+  if (!s)
+    {
+      err_id = ERR_MALLOC_NULL;
+      return close(fd), NULL;
+    }
+
+  s->len = sb.st_size;
+  s->mapped = 1;
+  s->bases = mmap(NULL, s->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  //The mapping keeps its own reference on the file
+  close(fd);
+  
+  if (s->bases == MAP_FAILED)
+    {
+      err_id = ERR_MMAP;
+      return free(s), NULL;
+    }
+
+  madvise(s->bases, s->len, MADV_SEQUENTIAL);
+  madvise(s->bases, s->len, MADV_WILLNEED);
+
+  if (huge)
+    madvise(s->bases, s->len, MADV_HUGEPAGE);
+  
+  return s;
+}